@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Контрольная сумма по 8-байтным словам: данные можно подавать кусками
+// произвольной длины, неполное слово копится до следующего куска
+class Checksum {
+public:
+    void Update(const char* data, size_t size) {
+        while (size > 0 && pending_size_ > 0) {
+            Feed(*data++, size);
+        }
+        for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            Mix(word);
+        }
+        while (size > 0) {
+            Feed(*data++, size);
+        }
+    }
+
+    uint64_t Finish() {
+        if (pending_size_ > 0) {
+            Mix(pending_);
+        }
+        return hash_;
+    }
+
+private:
+    uint64_t hash_ = 0xcbf29ce484222325ull;
+    uint64_t pending_ = 0;
+    size_t pending_size_ = 0;
+
+    void Mix(uint64_t word) {
+        hash_ = (hash_ ^ word) * 0x100000001b3ull;
+        hash_ ^= hash_ >> 29;
+    }
+
+    void Feed(char c, size_t& size) {
+        pending_ |= static_cast<uint64_t>(static_cast<unsigned char>(c)) << (8 * pending_size_);
+        --size;
+        if (++pending_size_ == sizeof(uint64_t)) {
+            Mix(pending_);
+            pending_ = 0;
+            pending_size_ = 0;
+        }
+    }
+};
@@ -1,58 +1,261 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <future>
 #include <map>
+#include <mutex>
 #include <numeric>
+#include <optional>
 #include <random>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <execution>
-#include <mutex>
 
 using namespace std::string_literals;
 
+// Спинлок с разделяемым режимом: читатели не мешают друг другу,
+// писатель ждёт, пока уйдут все читатели. Ждущий писатель выставляет
+// бит намерения, и новые читатели не входят, пока он не возьмёт замок,
+// поэтому поток читателей не может задержать писателя навсегда.
+class SharedSpinLock {
+public:
+    void lock() {
+        for (int spins = 0;; ++spins) {
+            uint32_t state = state_.load(std::memory_order_relaxed);
+            if ((state & ~WRITER_WAITING) == 0) {
+                // бит намерения снимается: другие ждущие писатели выставят его снова
+                if (state_.compare_exchange_weak(state, WRITER, std::memory_order_acquire)) {
+                    return;
+                }
+            } else if ((state & WRITER_WAITING) == 0) {
+                state_.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+            }
+            Pause(spins);
+        }
+    }
+
+    void unlock() {
+        // намерение писателей, пришедших во время записи, сохраняется
+        state_.fetch_and(~WRITER, std::memory_order_release);
+    }
+
+    void lock_shared() {
+        for (int spins = 0;; ++spins) {
+            uint32_t state = state_.load(std::memory_order_relaxed);
+            if ((state & (WRITER | WRITER_WAITING)) == 0
+                && state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+                return;
+            }
+            Pause(spins);
+        }
+    }
+
+    void unlock_shared() {
+        state_.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static constexpr uint32_t WRITER = 1u << 31;
+    static constexpr uint32_t WRITER_WAITING = 1u << 30;
+
+    // Первые попытки ждут подсказкой процессору, чтобы не отнимать ресурсы у соседнего
+    // гиперпотока и не гонять кэш-линию замка; дальше поток уступает процессор
+    static void Pause(int spins) {
+        if (spins < 64) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+            __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    std::atomic<uint32_t> state_ = 0;
+};
+
 template <typename Key, typename Value>
 class ConcurrentMap {
 public:
     static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
-    
+
     explicit ConcurrentMap(size_t chunk_count) : chunks_(chunk_count) {}
 
-    struct Chunk {
-        std::mutex mutex_;
-        std::map<Key, Value> chunk_map_;
+    // Часть словаря под своим замком: хеш-таблица с открытой адресацией
+    // и линейным пробированием. Каждая часть выровнена по кэш-линии,
+    // чтобы замки соседних частей не попадали в одну линию.
+    struct alignas(64) Chunk {
+        struct Slot {
+            Key key{};
+            Value value{};
+            bool occupied = false;
+        };
+
+        mutable SharedSpinLock lock_;
+        std::vector<Slot> slots_;
+        size_t size_ = 0;
+
+        size_t SlotIndex(const Key& key) const {
+            // старшие биты произведения не зависят от выбора части по остатку
+            const uint64_t hash = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(hash >> 32) & (slots_.size() - 1);
+        }
+
+        const Slot* Find(const Key& key) const {
+            if (slots_.empty()) {
+                return nullptr;
+            }
+            for (size_t i = SlotIndex(key);; i = (i + 1) & (slots_.size() - 1)) {
+                if (!slots_[i].occupied) {
+                    return nullptr;
+                }
+                if (slots_[i].key == key) {
+                    return &slots_[i];
+                }
+            }
+        }
+
+        Value& operator[](const Key& key) {
+            // коэффициент заполнения держим не выше 1/2
+            if (2 * (size_ + 1) > slots_.size()) {
+                Rehash(std::max<size_t>(8, 2 * slots_.size()));
+            }
+            size_t i = SlotIndex(key);
+            for (; slots_[i].occupied; i = (i + 1) & (slots_.size() - 1)) {
+                if (slots_[i].key == key) {
+                    return slots_[i].value;
+                }
+            }
+            slots_[i].key = key;
+            slots_[i].occupied = true;
+            ++size_;
+            return slots_[i].value;
+        }
+
+        size_t erase(const Key& key) {
+            const Slot* found = Find(key);
+            if (found == nullptr) {
+                return 0;
+            }
+            // удаление со сдвигом назад: вместо надгробий подтягиваем
+            // следующие элементы цепочки на освободившееся место
+            const size_t mask = slots_.size() - 1;
+            size_t hole = found - slots_.data();
+            for (size_t i = (hole + 1) & mask; slots_[i].occupied; i = (i + 1) & mask) {
+                const size_t home = SlotIndex(slots_[i].key);
+                if (((i - home) & mask) >= ((i - hole) & mask)) {
+                    slots_[hole] = std::move(slots_[i]);
+                    hole = i;
+                }
+            }
+            slots_[hole] = Slot{};
+            --size_;
+            return 1;
+        }
+
+        void Rehash(size_t capacity) {
+            std::vector<Slot> old_slots(capacity);
+            old_slots.swap(slots_);
+            size_ = 0;
+            for (Slot& slot : old_slots) {
+                if (slot.occupied) {
+                    (*this)[slot.key] = std::move(slot.value);
+                }
+            }
+        }
     };
 
     struct Access {
-        Access(const Key& key, Chunk& chunk) : guard(chunk.mutex_), ref_to_value(chunk.chunk_map_[key]){}
-        std::lock_guard<std::mutex> guard;
+        Access(const Key& key, Chunk& chunk) : guard(chunk.lock_), ref_to_value(chunk[key]){}
+        std::lock_guard<SharedSpinLock> guard;
         Value& ref_to_value;
     };
 
     Access operator[](const Key& key) {
-        return Access{key, chunks_[static_cast<uint64_t>(key) % chunks_.size()]};
+        return Access{key, GetChunk(key)};
+    }
+
+    // Читает значение под разделяемым замком, не мешая другим читателям
+    std::optional<Value> Find(const Key& key) const {
+        const Chunk& chunk = GetChunk(key);
+        std::shared_lock guard(chunk.lock_);
+        if (const auto* slot = chunk.Find(key)) {
+            return slot->value;
+        }
+        return std::nullopt;
     }
 
-    std::map<Key, Value> BuildOrdinaryMap() {
+    // Обходит все пары, части обрабатываются параллельно, каждая под разделяемым замком
+    template <typename Function>
+    void ForEach(Function function) const {
+        std::for_each(std::execution::par,
+                      std::begin(chunks_),
+                      std::end(chunks_),
+                      [&function](const Chunk& chunk) {
+                          std::shared_lock guard(chunk.lock_);
+                          for (const auto& slot : chunk.slots_) {
+                              if (slot.occupied) {
+                                  function(slot.key, slot.value);
+                              }
+                          }
+                      });
+    }
+
+    std::map<Key, Value> BuildOrdinaryMap() const {
+        // части копируются в общий массив параллельно, массив сортируется,
+        // а дерево строится вставками в конец за амортизированное O(1)
+        std::vector<std::vector<std::pair<Key, Value>>> parts(chunks_.size());
+        std::vector<size_t> indexes(chunks_.size());
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(std::execution::par,
+                      std::begin(indexes),
+                      std::end(indexes),
+                      [this, &parts](size_t index) {
+                          const Chunk& chunk = chunks_[index];
+                          std::shared_lock guard(chunk.lock_);
+                          parts[index].reserve(chunk.size_);
+                          for (const auto& slot : chunk.slots_) {
+                              if (slot.occupied) {
+                                  parts[index].emplace_back(slot.key, slot.value);
+                              }
+                          }
+                      });
+        std::vector<std::pair<Key, Value>> items;
+        items.reserve(std::transform_reduce(parts.begin(), parts.end(), size_t(0), std::plus<>{},
+                                            [](const auto& part) { return part.size(); }));
+        for (auto& part : parts) {
+            std::move(part.begin(), part.end(), std::back_inserter(items));
+        }
+        std::sort(std::execution::par, items.begin(), items.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+        });
+
         std::map<Key, Value> result;
-        
-        std::for_each(std::execution::seq,
-                        std::begin(chunks_),
-                        std::end(chunks_),
-                        [&result](auto& chunk_){
-                            std::lock_guard<std::mutex> guard(chunk_.mutex_);
-                            result.insert(chunk_.chunk_map_.begin(), chunk_.chunk_map_.end());
-                        });
+        for (auto& item : items) {
+            result.emplace_hint(result.end(), std::move(item));
+        }
         return result;
     }
-    
+
     auto erase(const Key& key) {
-        auto& chunk = chunks_[static_cast<uint64_t>(key) % chunks_.size()];
-        std::lock_guard guard(chunk.mutex_);
-        return chunk.chunk_map_.erase(key);
+        auto& chunk = GetChunk(key);
+        std::lock_guard guard(chunk.lock_);
+        return chunk.erase(key);
     }
 
 private:
     std::vector<Chunk> chunks_;
-};
\ No newline at end of file
+
+    Chunk& GetChunk(const Key& key) {
+        return chunks_[static_cast<uint64_t>(key) % chunks_.size()];
+    }
+
+    const Chunk& GetChunk(const Key& key) const {
+        return chunks_[static_cast<uint64_t>(key) % chunks_.size()];
+    }
+};
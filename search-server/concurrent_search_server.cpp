@@ -0,0 +1,99 @@
+#include "concurrent_search_server.h"
+
+#include <thread>
+
+ConcurrentSearchServer::ConcurrentSearchServer(const std::string& stop_words_text)
+    : ConcurrentSearchServer(std::make_unique<SearchServer>(stop_words_text)) {
+}
+
+ConcurrentSearchServer::ConcurrentSearchServer(std::unique_ptr<SearchServer> search_server)
+    : wal_(search_server->ReleaseWal()) {
+    copies_[1] = search_server->Clone();
+    copies_[0] = std::move(search_server);
+}
+
+ConcurrentSearchServer::ReadGuard::ReadGuard(const ConcurrentSearchServer& server) : server_(server) {
+    while (true) {
+        index_ = server_.active_.load(std::memory_order_seq_cst);
+        server_.readers_[index_].value.fetch_add(1, std::memory_order_seq_cst);
+        if (server_.active_.load(std::memory_order_seq_cst) == index_) {
+            return;
+        }
+        server_.readers_[index_].value.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+ConcurrentSearchServer::ReadGuard::~ReadGuard() {
+    server_.readers_[index_].value.fetch_sub(1, std::memory_order_release);
+}
+
+void ConcurrentSearchServer::WaitForReaders(size_t index) const {
+    while (readers_[index].value.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                                         const std::vector<int>& ratings) {
+    Write([&](SearchServer& server) {
+        server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::AddDocuments(const std::vector<SearchServer::NewDocument>& documents) {
+    Write([&documents](SearchServer& server) {
+        server.AddDocuments(documents);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Write([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+    });
+}
+
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                                               size_t top_k) const {
+    return Read([&](const SearchServer& server) {
+        return server.FindTopDocuments(raw_query, status, top_k);
+    });
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus> ConcurrentSearchServer::MatchDocument(std::string_view raw_query,
+                                                                                          int document_id) const {
+    // слова копируются: после чтения копия индекса может измениться
+    return Read([&](const SearchServer& server) {
+        const auto [words, status] = server.MatchDocument(raw_query, document_id);
+        return std::tuple{std::vector<std::string>(words.begin(), words.end()), status};
+    });
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return Read([](const SearchServer& server) {
+        return server.GetDocumentCount();
+    });
+}
+
+void ConcurrentSearchServer::SyncWal() {
+    std::lock_guard lock(writer_mutex_);
+    if (wal_) {
+        wal_->Sync();
+    }
+}
+
+void ConcurrentSearchServer::Checkpoint(const std::string& checkpoint_path) {
+    std::lock_guard lock(writer_mutex_);
+    if (wal_) {
+        wal_->Sync();
+    }
+    // под блокировкой писателя опубликованная копия не меняется, а снимок хранит
+    // LSN её последнего изменения, так что всё записанное в журнал уже в снимке
+    copies_[active_.load(std::memory_order_relaxed)]->SaveCheckpoint(checkpoint_path);
+    if (wal_) {
+        wal_->Reset();
+    }
+}
+
+uint64_t ConcurrentSearchServer::GetVersion() const {
+    return version_.load(std::memory_order_acquire);
+}
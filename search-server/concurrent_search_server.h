@@ -0,0 +1,158 @@
+#pragma once
+#include "search_server.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Поисковый сервер, который читают из многих потоков во время изменений.
+// Хранит две копии индекса: читатели работают с опубликованной, единственный
+// писатель применяет изменение к резервной, публикует её, дожидается, пока
+// с прежней копией закончат уже начавшие читатели, и повторяет изменение на ней.
+// Читатели не берут блокировок и не ждут писателя: чтение лишь отмечается
+// в счётчике своей копии. Каждое чтение видит индекс целиком до или целиком
+// после любого изменения. Цена — двойная память и двойная работа писателя.
+// Журнал упреждающей записи принадлежит самому серверу, а не копиям: записи
+// об изменении резервной копии пишутся в него один раз до её публикации.
+class ConcurrentSearchServer {
+public:
+    explicit ConcurrentSearchServer(const std::string& stop_words_text);
+
+    // Берёт готовый сервер (например, из SearchServer::Recover) и строит ему пару.
+    // Журнал переданного сервера переходит к ConcurrentSearchServer.
+    explicit ConcurrentSearchServer(std::unique_ptr<SearchServer> search_server);
+
+    // Вызывает reader(const SearchServer&) над опубликованной версией индекса
+    // и возвращает его результат. Ссылки на данные сервера нельзя выносить из reader.
+    template <typename Reader>
+    auto Read(Reader reader) const;
+
+    // Применяет writer(SearchServer&) к обеим копиям по очереди и публикует результат.
+    // writer должен быть детерминированным: с одинаковым индексом — одинаковый итог
+    // или одинаковое исключение. Исключение на первой копии или ошибка журнала
+    // ничего не меняют. Если после публикации writer бросит на второй копии,
+    // она пересоздаётся из опубликованной, а изменение считается выполненным.
+    template <typename Writer>
+    void Write(Writer writer);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void AddDocuments(const std::vector<SearchServer::NewDocument>& documents);
+
+    void RemoveDocument(int document_id);
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    // Сбрасывает на диск изменения, накопленные журналом в группе
+    void SyncWal();
+
+    // Атомарно заменяет контрольную точку снимком опубликованной копии и очищает журнал.
+    // Изменения на время записи снимка ждут, чтения идут как обычно.
+    void Checkpoint(const std::string& checkpoint_path);
+
+    // Число опубликованных изменений; растёт с каждой публикацией
+    uint64_t GetVersion() const;
+
+private:
+    // Отмечает чтение в счётчике опубликованной копии. Если между выбором копии
+    // и отметкой писатель успел её сменить, отметка снимается и выбор повторяется,
+    // так что писатель, увидев нулевой счётчик, может менять копию.
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const ConcurrentSearchServer& server);
+        ~ReadGuard();
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        const SearchServer& Get() const {
+            return *server_.copies_[index_];
+        }
+
+    private:
+        const ConcurrentSearchServer& server_;
+        size_t index_;
+    };
+
+    // счётчики читателей на разных кэш-линиях, чтобы не мешать друг другу
+    struct alignas(64) ReaderCount {
+        mutable std::atomic<uint64_t> value = 0;
+    };
+
+    // резервная копия пуста, если её не удалось пересоздать; тогда она пересоздаётся при следующем Write
+    std::array<std::unique_ptr<SearchServer>, 2> copies_;
+    std::unique_ptr<WriteAheadLog> wal_;
+    std::array<ReaderCount, 2> readers_;
+    std::atomic<size_t> active_ = 0;
+    std::atomic<uint64_t> version_ = 0;
+    std::mutex writer_mutex_;
+
+    void WaitForReaders(size_t index) const;
+};
+
+template <typename Reader>
+auto ConcurrentSearchServer::Read(Reader reader) const {
+    const ReadGuard guard(*this);
+    return reader(guard.Get());
+}
+
+template <typename Writer>
+void ConcurrentSearchServer::Write(Writer writer) {
+    std::lock_guard lock(writer_mutex_);
+    const size_t active = active_.load(std::memory_order_relaxed);
+    const size_t standby = 1 - active;
+    if (!copies_[standby]) {
+        copies_[standby] = copies_[active]->Clone();
+    }
+    // записи журнала собираются с первой копии, пока она не видна читателям
+    std::vector<SearchServer::WalRecord> records;
+    copies_[standby]->SetWalRecordSink(&records);
+    try {
+        writer(*copies_[standby]);
+    } catch (...) {
+        // writer мог успеть изменить копию частично, а в журнал это не попало:
+        // копия пересоздаётся, иначе изменение опубликовал бы следующий Write
+        copies_[standby].reset();
+        copies_[standby] = copies_[active]->Clone();
+        throw;
+    }
+    copies_[standby]->SetWalRecordSink(nullptr);
+    uint64_t last_lsn = 0;
+    if (wal_ && !records.empty()) {
+        try {
+            for (const auto& record : records) {
+                last_lsn = wal_->Append(record.type, record.payload);
+            }
+        } catch (...) {
+            // изменение не записано, поэтому его нельзя публиковать: резервная копия откатывается
+            copies_[standby].reset();
+            copies_[standby] = copies_[active]->Clone();
+            throw;
+        }
+        copies_[standby]->SetLastLsn(last_lsn);
+    }
+    active_.store(standby, std::memory_order_seq_cst);
+    version_.fetch_add(1, std::memory_order_release);
+    WaitForReaders(active);
+    try {
+        writer(*copies_[active]);
+    } catch (...) {
+        copies_[active].reset();
+        copies_[active] = copies_[standby]->Clone();
+        return;
+    }
+    if (last_lsn != 0) {
+        copies_[active]->SetLastLsn(last_lsn);
+    }
+}
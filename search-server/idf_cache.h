@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+// Кэш IDF термов, индексированный id терма.
+// Любое изменение индекса (число документов или частоты термов) увеличивает
+// эпоху; значение терма пересчитывается при первом чтении в новой эпохе,
+// поэтому массовое добавление документов не тратит время на пересчёт.
+// Чтения могут идти из нескольких потоков: каждая запись кэша — пара атомарных
+// полей, и эпоха публикуется после значения. Изменять индекс одновременно
+// с чтением нельзя, как и для остального поискового сервера.
+class IdfCache {
+public:
+    // Добавляет записи для новых термов; существующие записи не перемещаются
+    void Resize(size_t term_count) {
+        while (entries_.size() < term_count) {
+            entries_.emplace_back();
+        }
+    }
+
+    // Делает устаревшими все сохранённые значения
+    void Invalidate() {
+        ++epoch_;
+    }
+
+    // Возвращает значение терма текущей эпохи, при необходимости вычисляя его через compute()
+    template <typename Compute>
+    double Get(uint32_t term_id, Compute compute) const {
+        const Entry& entry = entries_[term_id];
+        if (entry.epoch.load(std::memory_order_acquire) == epoch_) {
+            return entry.value.load(std::memory_order_relaxed);
+        }
+        // несколько потоков могут пересчитать одно значение одновременно,
+        // но все они запишут одно и то же число
+        const double value = compute();
+        entry.value.store(value, std::memory_order_relaxed);
+        entry.epoch.store(epoch_, std::memory_order_release);
+        return value;
+    }
+
+private:
+    struct Entry {
+        mutable std::atomic<double> value = 0.0;
+        // 0 — значение ещё не вычислялось
+        mutable std::atomic<uint64_t> epoch = 0;
+    };
+
+    std::deque<Entry> entries_;
+    uint64_t epoch_ = 1;
+};
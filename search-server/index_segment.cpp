@@ -0,0 +1,134 @@
+#include "index_segment.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+IndexSegment::IndexSegment(Ordinal first_ordinal) : first_ordinal_(first_ordinal) {
+}
+
+IndexSegment::IndexSegment(Ordinal first_ordinal, std::vector<double> inv_word_counts,
+                           std::vector<PostingList> term_postings, bool sealed, size_t purged_count,
+                           std::function<void()> verify_postings)
+    : first_ordinal_(first_ordinal)
+    , inv_word_counts_(std::move(inv_word_counts))
+    , term_postings_(std::move(term_postings))
+    , deleted_bits_((inv_word_counts_.size() + 63) / 64)
+    , purged_count_(purged_count)
+    , sealed_(sealed)
+    , verify_postings_(std::move(verify_postings))
+    , postings_verified_(!verify_postings_) {
+}
+
+const PostingList& IndexSegment::GetPostings(TermId term_id) const {
+    static const PostingList empty;
+    VerifyPostings();
+    return term_id < term_postings_.size() ? term_postings_[term_id] : empty;
+}
+
+IndexSegment::Ordinal IndexSegment::AppendDocument(double inv_word_count) {
+    if (sealed_) {
+        throw std::logic_error("Cannot add documents to a sealed segment");
+    }
+    const Ordinal ordinal = GetLastOrdinal();
+    inv_word_counts_.push_back(inv_word_count);
+    if (deleted_bits_.size() * 64 < inv_word_counts_.size()) {
+        deleted_bits_.push_back(0);
+    }
+    return ordinal;
+}
+
+void IndexSegment::ResizeTerms(size_t term_count) {
+    if (term_postings_.size() < term_count) {
+        term_postings_.resize(term_count);
+    }
+}
+
+PostingList& IndexSegment::GetMutablePostings(TermId term_id) {
+    if (sealed_) {
+        throw std::logic_error("Cannot modify postings of a sealed segment");
+    }
+    VerifyPostings();
+    return term_postings_.at(term_id);
+}
+
+void IndexSegment::Seal() {
+    for (PostingList& postings : term_postings_) {
+        postings.ShrinkToFit();
+    }
+    inv_word_counts_.shrink_to_fit();
+    term_postings_.shrink_to_fit();
+    sealed_ = true;
+}
+
+void IndexSegment::MarkDeleted(Ordinal ordinal) {
+    const size_t offset = ordinal - first_ordinal_;
+    uint64_t& word = deleted_bits_.at(offset / 64);
+    const uint64_t bit = uint64_t{1} << (offset % 64);
+    if ((word & bit) == 0) {
+        word |= bit;
+        ++deleted_count_;
+    }
+}
+
+void IndexSegment::CopyDeletedFrom(const IndexSegment& other) {
+    for (Ordinal ordinal = other.GetFirstOrdinal(); ordinal < other.GetLastOrdinal(); ++ordinal) {
+        if (other.IsDeleted(ordinal)) {
+            MarkDeleted(ordinal);
+        }
+    }
+}
+
+std::shared_ptr<IndexSegment> IndexSegment::Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                                  const std::vector<std::vector<uint64_t>>& deleted_bits) {
+    auto result = std::make_shared<IndexSegment>(segments.front()->first_ordinal_);
+    size_t term_count = 0;
+    for (const auto& segment : segments) {
+        if (!segment->sealed_ || segment->first_ordinal_ != result->GetLastOrdinal()) {
+            throw std::logic_error("Only adjacent sealed segments can be merged");
+        }
+        result->inv_word_counts_.insert(result->inv_word_counts_.end(),
+                                        segment->inv_word_counts_.begin(), segment->inv_word_counts_.end());
+        term_count = std::max(term_count, segment->term_postings_.size());
+    }
+    result->deleted_bits_.assign((result->inv_word_counts_.size() + 63) / 64, 0);
+    for (const auto& bits : deleted_bits) {
+        for (const uint64_t word : bits) {
+            result->purged_count_ += __builtin_popcountll(word);
+        }
+    }
+    result->term_postings_.resize(term_count);
+
+    // номера сегментов идут подряд, поэтому каждый список собирается дописыванием в конец
+    for (TermId term_id = 0; term_id < term_count; ++term_id) {
+        PostingList& merged = result->term_postings_[term_id];
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const IndexSegment& segment = *segments[i];
+            for (const auto [document_id, count] : segment.GetPostings(term_id)) {
+                const size_t offset = document_id - segment.first_ordinal_;
+                if ((deleted_bits[i][offset / 64] >> (offset % 64)) & 1) {
+                    continue;
+                }
+                merged.Append(document_id, count, count * segment.inv_word_counts_[offset]);
+            }
+        }
+    }
+    result->Seal();
+    return result;
+}
+
+void IndexSegment::VerifyPostings() const {
+    if (!postings_verified_.load(std::memory_order_acquire)) {
+        verify_postings_();
+        postings_verified_.store(true, std::memory_order_release);
+    }
+}
+
+size_t IndexSegment::MemoryUsage() const {
+    size_t result = sizeof(*this) + inv_word_counts_.capacity() * sizeof(double)
+                    + deleted_bits_.capacity() * sizeof(uint64_t)
+                    + (term_postings_.capacity() - term_postings_.size()) * sizeof(PostingList);
+    for (const PostingList& postings : term_postings_) {
+        result += postings.MemoryUsage();
+    }
+    return result;
+}
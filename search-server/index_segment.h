@@ -0,0 +1,132 @@
+#pragma once
+#include "posting_list.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Сегмент индекса: списки вхождений документов с порядковыми номерами
+// из [GetFirstOrdinal(), GetLastOrdinal()), индексированные id терма.
+// Новые документы дописываются в открытый сегмент. После Seal списки вхождений
+// и длины документов сегмента не меняются, поэтому запечатанный сегмент можно
+// читать из другого потока, например при фоновом слиянии.
+// Удаление только отмечается в битовой карте сегмента; сами записи
+// удалённых документов выбрасываются, когда сегмент сливается с соседями
+// или переписывается (Merge из одного сегмента).
+class IndexSegment {
+public:
+    using Ordinal = uint32_t;
+    using TermId = uint32_t;
+
+    explicit IndexSegment(Ordinal first_ordinal);
+
+    // Сегмент из готовых списков вхождений (например, загруженных из снимка).
+    // purged_count — сколько удалённых документов уже без записей в списках;
+    // сами отметки об удалении ставит MarkDeleted. verify_postings, если задана,
+    // проверяет данные списков (контрольные суммы снимка, из которого они читаются)
+    // и вызывается один раз перед первым чтением их записей; её исключение
+    // пробрасывается из этого чтения.
+    IndexSegment(Ordinal first_ordinal, std::vector<double> inv_word_counts,
+                 std::vector<PostingList> term_postings, bool sealed, size_t purged_count,
+                 std::function<void()> verify_postings = {});
+
+    Ordinal GetFirstOrdinal() const {
+        return first_ordinal_;
+    }
+
+    Ordinal GetLastOrdinal() const {
+        return first_ordinal_ + static_cast<Ordinal>(inv_word_counts_.size());
+    }
+
+    size_t GetDocumentCount() const {
+        return inv_word_counts_.size();
+    }
+
+    size_t GetLiveDocumentCount() const {
+        return inv_word_counts_.size() - deleted_count_;
+    }
+
+    // Удалённые документы, записей которых уже нет в списках сегмента
+    size_t GetPurgedCount() const {
+        return purged_count_;
+    }
+
+    // Удалённые документы, записи которых ещё лежат в списках сегмента
+    size_t GetTombstoneCount() const {
+        return deleted_count_ - purged_count_;
+    }
+
+    // Доля записей удалённых документов среди документов, чьи записи есть в сегменте
+    double GetTombstoneRatio() const {
+        const size_t indexed = inv_word_counts_.size() - purged_count_;
+        return indexed == 0 ? 0.0 : static_cast<double>(GetTombstoneCount()) / indexed;
+    }
+
+    bool IsSealed() const {
+        return sealed_;
+    }
+
+    // Число термов, для которых в сегменте заведены списки
+    size_t GetTermCount() const {
+        return term_postings_.size();
+    }
+
+    // Список вхождений терма; для терма, которого нет в сегменте, — пустой список
+    const PostingList& GetPostings(TermId term_id) const;
+
+    // Дописывает документ в открытый сегмент и возвращает его порядковый номер.
+    // Записи документа добавляются в списки из GetMutablePostings.
+    Ordinal AppendDocument(double inv_word_count);
+
+    void ResizeTerms(size_t term_count);
+
+    PostingList& GetMutablePostings(TermId term_id);
+
+    // Закрывает сегмент для добавления и ужимает его списки
+    void Seal();
+
+    void MarkDeleted(Ordinal ordinal);
+
+    bool IsDeleted(Ordinal ordinal) const {
+        const size_t offset = ordinal - first_ordinal_;
+        return (deleted_bits_[offset / 64] >> (offset % 64)) & 1;
+    }
+
+    // Копия битовой карты удалений для фонового слияния
+    std::vector<uint64_t> GetDeletedBits() const {
+        return deleted_bits_;
+    }
+
+    // Переносит отметки об удалении из сегмента, номера которого входят в этот
+    void CopyDeletedFrom(const IndexSegment& other);
+
+    // Сливает соседние запечатанные сегменты в один запечатанный, выбрасывая записи
+    // документов, отмеченных в deleted_bits (по одной карте на сегмент).
+    // Отметки об удалении в результат не переносятся, это делает CopyDeletedFrom;
+    // выброшенные документы после этого не считаются в GetTombstoneCount.
+    static std::shared_ptr<IndexSegment> Merge(const std::vector<std::shared_ptr<const IndexSegment>>& segments,
+                                               const std::vector<std::vector<uint64_t>>& deleted_bits);
+
+    // Объём памяти в байтах, принадлежащей сегменту
+    size_t MemoryUsage() const;
+
+private:
+    Ordinal first_ordinal_;
+    // 1 / число слов документа, индекс — смещение от first_ordinal_; из этого
+    // восстанавливаются веса записей при слиянии
+    std::vector<double> inv_word_counts_;
+    std::vector<PostingList> term_postings_;
+    std::vector<uint64_t> deleted_bits_;
+    size_t deleted_count_ = 0;
+    // сколько из удалённых документов уже без записей в списках
+    size_t purged_count_ = 0;
+    bool sealed_ = false;
+    std::function<void()> verify_postings_;
+    // гонка двух проверок безвредна: проверка не меняет данных
+    mutable std::atomic<bool> postings_verified_ = true;
+
+    void VerifyPostings() const;
+};
@@ -0,0 +1,80 @@
+#include "near_duplicate_index.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+NearDuplicateIndex::NearDuplicateIndex(const Options& options)
+    : options_(options) {
+    if (options_.band_count == 0 || options_.signature_length % options_.band_count != 0
+        || options_.signature_length == 0) {
+        throw std::invalid_argument("Signature length must be a positive multiple of band count"s);
+    }
+    rows_ = options_.signature_length / options_.band_count;
+    // фиксированное зерно: подписи одних и тех же документов совпадают между индексами
+    std::mt19937_64 generator(0x6d696e68617368);
+    for (size_t i = 0; i < options_.signature_length; ++i) {
+        multipliers_.push_back(generator() | 1);
+        increments_.push_back(generator());
+    }
+    buckets_.resize(options_.band_count);
+}
+
+void NearDuplicateIndex::Add(int document_id, Signature signature) {
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        buckets_[band][HashBand(signature, band)].push_back(document_id);
+    }
+    signatures_[document_id] = std::move(signature);
+}
+
+void NearDuplicateIndex::Remove(int document_id) {
+    const auto it = signatures_.find(document_id);
+    if (it == signatures_.end()) {
+        return;
+    }
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        const auto bucket_it = buckets_[band].find(HashBand(it->second, band));
+        std::vector<int>& bucket = bucket_it->second;
+        *std::find(bucket.begin(), bucket.end(), document_id) = bucket.back();
+        bucket.pop_back();
+        if (bucket.empty()) {
+            buckets_[band].erase(bucket_it);
+        }
+    }
+    signatures_.erase(it);
+}
+
+std::vector<int> NearDuplicateIndex::GetCandidates(const Signature& signature) const {
+    std::vector<int> candidates;
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        if (const auto it = buckets_[band].find(HashBand(signature, band)); it != buckets_[band].end()) {
+            candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    return candidates;
+}
+
+const NearDuplicateIndex::Signature* NearDuplicateIndex::FindSignature(int document_id) const {
+    const auto it = signatures_.find(document_id);
+    return it == signatures_.end() ? nullptr : &it->second;
+}
+
+uint64_t NearDuplicateIndex::Mix(uint64_t x) {
+    // финализатор splitmix64
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t NearDuplicateIndex::HashBand(const Signature& signature, size_t band) const {
+    uint64_t hash = band;
+    for (size_t i = band * rows_; i < (band + 1) * rows_; ++i) {
+        hash = Mix(hash ^ signature[i]);
+    }
+    return hash;
+}
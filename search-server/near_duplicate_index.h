@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Индекс почти-дубликатов: MinHash-подписи множеств термов и LSH по полосам.
+// Подпись — минимумы signature_length хеш-функций по термам документа; доля
+// совпадающих позиций двух подписей оценивает меру Жаккара их множеств.
+// Подпись режется на band_count полос по rows = signature_length / band_count
+// позиций, и документы с совпавшей полосой становятся кандидатами: пара со
+// сходством s попадает в кандидаты с вероятностью 1 - (1 - s^rows)^band_count.
+// Поиск кандидатов не перебирает все пары, точное сходство проверяет вызывающий.
+class NearDuplicateIndex {
+public:
+    struct Options {
+        size_t signature_length = 128;
+        // должно делить signature_length
+        size_t band_count = 32;
+        // отбраковывать в AddDocument документы, сходство которых с уже добавленным
+        // не меньше reject_threshold
+        bool reject_on_insert = false;
+        double reject_threshold = 0.9;
+    };
+
+    using Signature = std::vector<uint32_t>;
+
+    explicit NearDuplicateIndex(const Options& options);
+
+    // Подпись множества термов; projection(item) даёт id терма, термы не повторяются
+    template <typename Range, typename Projection>
+    Signature ComputeSignature(const Range& terms, Projection projection) const {
+        Signature signature(options_.signature_length, std::numeric_limits<uint32_t>::max());
+        for (const auto& item : terms) {
+            const uint64_t hash = Mix(projection(item));
+            for (size_t i = 0; i < signature.size(); ++i) {
+                const auto value = static_cast<uint32_t>((hash * multipliers_[i] + increments_[i]) >> 32);
+                signature[i] = value < signature[i] ? value : signature[i];
+            }
+        }
+        return signature;
+    }
+
+    void Add(int document_id, Signature signature);
+
+    void Remove(int document_id);
+
+    // Документы, у которых хотя бы одна полоса подписи совпала с signature, без повторов
+    std::vector<int> GetCandidates(const Signature& signature) const;
+
+    // Подпись добавленного документа или nullptr
+    const Signature* FindSignature(int document_id) const;
+
+    size_t GetDocumentCount() const {
+        return signatures_.size();
+    }
+
+    const Options& GetOptions() const {
+        return options_;
+    }
+
+private:
+    Options options_;
+    size_t rows_;
+    // параметры хеш-функций h_i(x) = (a_i * Mix(x) + b_i) >> 32, a_i нечётны
+    std::vector<uint64_t> multipliers_;
+    std::vector<uint64_t> increments_;
+    std::unordered_map<int, Signature> signatures_;
+    // для каждой полосы: хеш полосы -> документы
+    std::vector<std::unordered_map<uint64_t, std::vector<int>>> buckets_;
+
+    static uint64_t Mix(uint64_t x);
+
+    uint64_t HashBand(const Signature& signature, size_t band) const;
+};
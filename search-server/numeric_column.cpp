@@ -0,0 +1,104 @@
+#include "numeric_column.h"
+
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SEARCH_SERVER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Хвост не вливается в индекс, пока он короче этого
+constexpr size_t MIN_TAIL = 1'024;
+
+// Диапазон, в который попадает больше этой доли значений, дешевле найти проходом по столбцу,
+// чем расставлять биты по индексу вразброс
+constexpr size_t DENSE_RANGE_DIVISOR = 16;
+
+bool IsInRange(int value, int min_value, int max_value) {
+    return static_cast<uint32_t>(value) - static_cast<uint32_t>(min_value)
+           <= static_cast<uint32_t>(max_value) - static_cast<uint32_t>(min_value);
+}
+
+// Биты 64 значений, начиная с values, которые лежат в [min_value, max_value]
+uint64_t GetRangeMask(const int* values, int min_value, int max_value) {
+    uint64_t mask = 0;
+#ifdef SEARCH_SERVER_SSE2
+    const __m128i min_vector = _mm_set1_epi32(min_value);
+    const __m128i max_vector = _mm_set1_epi32(max_value);
+    for (int i = 0; i < 64; i += 4) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        const __m128i outside = _mm_or_si128(_mm_cmplt_epi32(block, min_vector), _mm_cmpgt_epi32(block, max_vector));
+        const auto outside_bits = static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(outside)));
+        mask |= (~outside_bits & 0xF) << i;
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        mask |= uint64_t{IsInRange(values[i], min_value, max_value)} << i;
+    }
+#endif
+    return mask;
+}
+
+// Отмечает в bits номера из [first, values.size()), значения которых лежат в диапазоне
+void ScanRange(const std::vector<int>& values, size_t first, int min_value, int max_value, std::vector<uint64_t>& bits) {
+    size_t ordinal = first;
+    for (; ordinal < values.size() && ordinal % 64 != 0; ++ordinal) {
+        bits[ordinal / 64] |= uint64_t{IsInRange(values[ordinal], min_value, max_value)} << (ordinal % 64);
+    }
+    for (; ordinal + 64 <= values.size(); ordinal += 64) {
+        bits[ordinal / 64] |= GetRangeMask(values.data() + ordinal, min_value, max_value);
+    }
+    for (; ordinal < values.size(); ++ordinal) {
+        bits[ordinal / 64] |= uint64_t{IsInRange(values[ordinal], min_value, max_value)} << (ordinal % 64);
+    }
+}
+
+}  // namespace
+
+void NumericColumn::Append(int value) {
+    values_.push_back(value);
+    const size_t tail = values_.size() - sorted_.size();
+    if (tail >= MIN_TAIL && tail > sorted_.size() / 8) {
+        MergeTail();
+    }
+}
+
+void NumericColumn::CollectRange(int min_value, int max_value, std::vector<uint64_t>& bits) const {
+    bits.assign((values_.size() + 63) / 64, 0);
+    if (min_value > max_value) {
+        return;
+    }
+    const auto first = std::lower_bound(sorted_.begin(), sorted_.end(), min_value, [](const Entry& entry, int value) {
+        return entry.value < value;
+    });
+    const auto last = std::upper_bound(first, sorted_.end(), max_value, [](int value, const Entry& entry) {
+        return value < entry.value;
+    });
+    if (static_cast<size_t>(last - first) > values_.size() / DENSE_RANGE_DIVISOR) {
+        ScanRange(values_, 0, min_value, max_value, bits);
+        return;
+    }
+    for (auto it = first; it != last; ++it) {
+        bits[it->ordinal / 64] |= uint64_t{1} << (it->ordinal % 64);
+    }
+    ScanRange(values_, sorted_.size(), min_value, max_value, bits);
+}
+
+size_t NumericColumn::MemoryUsage() const {
+    return values_.capacity() * sizeof(int) + sorted_.capacity() * sizeof(Entry);
+}
+
+void NumericColumn::MergeTail() {
+    const size_t middle = sorted_.size();
+    for (size_t ordinal = middle; ordinal < values_.size(); ++ordinal) {
+        sorted_.push_back({values_[ordinal], static_cast<uint32_t>(ordinal)});
+    }
+    auto by_value = [](const Entry& lhs, const Entry& rhs) {
+        return lhs.value < rhs.value;
+    };
+    // номера хвоста возрастают, поэтому устойчивая сортировка оставляет равные значения по номерам
+    std::stable_sort(sorted_.begin() + middle, sorted_.end(), by_value);
+    std::inplace_merge(sorted_.begin(), sorted_.begin() + middle, sorted_.end(), by_value);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Столбец целочисленного атрибута документов (рейтинга и подобных) с индексом
+// для запросов по диапазону. Значение хранится по порядковому номеру документа.
+// Индекс — пары (значение, номер), упорядоченные по значению, для всех номеров,
+// кроме недавно дописанного хвоста; хвост вливается в индекс, когда становится
+// длиннее восьмой части столбца, так что дописывание стоит амортизированно O(log n).
+// Удаление документов столбец не отслеживает: его отсекает карта живых документов.
+class NumericColumn {
+public:
+    void Append(int value);
+
+    int Get(uint32_t ordinal) const {
+        return values_[ordinal];
+    }
+
+    size_t size() const {
+        return values_.size();
+    }
+
+    // Записывает в bits карту номеров, значения которых лежат в [min_value, max_value]:
+    // бит ordinal % 64 слова ordinal / 64. Карта покрывает весь столбец.
+    void CollectRange(int min_value, int max_value, std::vector<uint64_t>& bits) const;
+
+    // Объём памяти в байтах, занимаемый столбцом и индексом
+    size_t MemoryUsage() const;
+
+private:
+    struct Entry {
+        int value;
+        uint32_t ordinal;
+    };
+
+    std::vector<int> values_;
+    // индекс номеров [0, sorted_.size()), упорядоченный по значению
+    std::vector<Entry> sorted_;
+
+    // Вливает хвост столбца в индекс
+    void MergeTail();
+};
@@ -0,0 +1,217 @@
+#include "posting_list.h"
+
+#include <algorithm>
+
+PostingList::Iterator::Iterator(const PostingList* list, size_t position)
+    : list_(list), data_(list->Data()), position_(position) {
+    if (position_ < list_->size_) {
+        SeekBlock(position_ / BLOCK_SIZE);
+    }
+}
+
+PostingList::Iterator& PostingList::Iterator::operator++() {
+    ++position_;
+    if (position_ < list_->size_) {
+        DecodeNext(current_.document_id);
+    }
+    return *this;
+}
+
+PostingList::Iterator PostingList::Iterator::operator++(int) {
+    Iterator result = *this;
+    ++(*this);
+    return result;
+}
+
+void PostingList::Iterator::SkipTo(int document_id) {
+    if (position_ >= list_->size_ || current_.document_id >= document_id) {
+        return;
+    }
+    const Block* blocks = list_->BlocksBegin();
+    const size_t block = position_ / BLOCK_SIZE;
+    if (blocks[block].last_id < document_id) {
+        const Block* it = std::partition_point(blocks + block + 1, list_->BlocksEnd(),
+                                               [document_id](const Block& b) {
+                                                   return b.last_id < document_id;
+                                               });
+        if (it == list_->BlocksEnd()) {
+            position_ = list_->size_;
+            return;
+        }
+        SeekBlock(it - blocks);
+    }
+    while (position_ < list_->size_ && current_.document_id < document_id) {
+        ++(*this);
+    }
+}
+
+PostingList::BlockBound PostingList::Iterator::PeekBlock(int document_id) const {
+    if (position_ >= list_->size_) {
+        return {};
+    }
+    const Block* blocks = list_->BlocksBegin();
+    const size_t block = position_ / BLOCK_SIZE;
+    if (blocks[block].last_id >= document_id) {
+        return {blocks[block].last_id, blocks[block].max_weight};
+    }
+    const Block* it = std::partition_point(blocks + block + 1, list_->BlocksEnd(),
+                                           [document_id](const Block& b) {
+                                               return b.last_id < document_id;
+                                           });
+    if (it == list_->BlocksEnd()) {
+        return {};
+    }
+    return {it->last_id, it->max_weight};
+}
+
+void PostingList::Iterator::SeekBlock(size_t block) {
+    const Block& header = list_->BlocksBegin()[block];
+    position_ = block * BLOCK_SIZE;
+    offset_ = header.offset;
+    DecodeNext(header.base_id);
+}
+
+void PostingList::Iterator::DecodeNext(int previous_id) {
+    current_.document_id = previous_id + static_cast<int>(DecodeVarint(data_, offset_));
+    current_.term_count = DecodeVarint(data_, offset_);
+}
+
+void PostingList::Append(int document_id, uint32_t term_count, double weight) {
+    Detach();
+    if (document_id < 0 || (size_ > 0 && document_id <= blocks_.back().last_id)) {
+        throw std::invalid_argument("Posting list document ids must be non-negative and increasing");
+    }
+    const int previous_id = size_ == 0 ? 0 : blocks_.back().last_id;
+    if (size_ % BLOCK_SIZE == 0) {
+        blocks_.push_back({weight, previous_id, document_id, static_cast<uint32_t>(data_.size())});
+    }
+    EncodeVarint(data_, static_cast<uint32_t>(document_id - previous_id));
+    EncodeVarint(data_, term_count);
+    Block& block = blocks_.back();
+    block.last_id = document_id;
+    block.max_weight = std::max(block.max_weight, weight);
+    max_weight_ = std::max(max_weight_, weight);
+    ++size_;
+}
+
+void PostingList::Insert(int document_id, uint32_t term_count, double weight) {
+    if (size_ == 0 || document_id > BlocksEnd()[-1].last_id) {
+        Append(document_id, term_count, weight);
+        return;
+    }
+    if (Contains(document_id)) {
+        throw std::invalid_argument("Document is already in posting list");
+    }
+    *this = Rebuild(std::nullopt, WeightedPosting{{document_id, term_count}, weight});
+}
+
+size_t PostingList::Erase(int document_id) {
+    if (!Contains(document_id)) {
+        return 0;
+    }
+    *this = Rebuild(document_id, std::nullopt);
+    return 1;
+}
+
+PostingList PostingList::Rebuild(std::optional<int> erase_id, std::optional<WeightedPosting> insert) const {
+    PostingList result;
+    result.data_.reserve((external_data_ != nullptr ? external_data_size_ : data_.size()) + 10);
+    result.blocks_.reserve(BlocksEnd() - BlocksBegin() + 1);
+    for (auto it = begin(); it != end(); ++it) {
+        if (insert && insert->posting.document_id < it->document_id) {
+            result.Append(insert->posting.document_id, insert->posting.term_count, insert->weight);
+            insert.reset();
+        }
+        if (it->document_id != erase_id) {
+            result.Append(it->document_id, it->term_count, BlocksBegin()[it.position_ / BLOCK_SIZE].max_weight);
+        }
+    }
+    if (insert) {
+        result.Append(insert->posting.document_id, insert->posting.term_count, insert->weight);
+    }
+    return result;
+}
+
+PostingList::Iterator PostingList::Find(int document_id) const {
+    Iterator it = begin();
+    it.SkipTo(document_id);
+    if (it != end() && it->document_id == document_id) {
+        return it;
+    }
+    return end();
+}
+
+bool PostingList::Contains(int document_id) const {
+    return Find(document_id) != end();
+}
+
+PostingList::Iterator PostingList::begin() const {
+    return Iterator(this, 0);
+}
+
+PostingList::Iterator PostingList::end() const {
+    return Iterator(this, size_);
+}
+
+size_t PostingList::MemoryUsage() const {
+    return sizeof(*this) + data_.capacity() + blocks_.capacity() * sizeof(Block);
+}
+
+void PostingList::ShrinkToFit() {
+    data_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+}
+
+PostingList::RawData PostingList::GetRawData() const {
+    return {Data(),
+            external_data_ != nullptr ? external_data_size_ : data_.size(),
+            BlocksBegin(),
+            static_cast<size_t>(BlocksEnd() - BlocksBegin()),
+            size_,
+            max_weight_};
+}
+
+PostingList PostingList::FromRawData(const RawData& raw) {
+    if (raw.block_count != (raw.size + BLOCK_SIZE - 1) / BLOCK_SIZE) {
+        throw std::invalid_argument("Posting list block count does not match its size");
+    }
+    PostingList result;
+    result.external_data_ = raw.data;
+    result.external_data_size_ = raw.data_size;
+    result.external_blocks_ = raw.blocks;
+    result.external_block_count_ = raw.block_count;
+    result.size_ = raw.size;
+    result.max_weight_ = raw.max_weight;
+    return result;
+}
+
+void PostingList::Detach() {
+    if (external_data_ == nullptr) {
+        return;
+    }
+    data_.assign(external_data_, external_data_ + external_data_size_);
+    blocks_.assign(external_blocks_, external_blocks_ + external_block_count_);
+    external_data_ = nullptr;
+    external_data_size_ = 0;
+    external_blocks_ = nullptr;
+    external_block_count_ = 0;
+}
+
+void PostingList::EncodeVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t PostingList::DecodeVarint(const uint8_t* data, size_t& offset) {
+    uint32_t result = 0;
+    int shift = 0;
+    while (data[offset] & 0x80) {
+        result |= static_cast<uint32_t>(data[offset++] & 0x7F) << shift;
+        shift += 7;
+    }
+    result |= static_cast<uint32_t>(data[offset++]) << shift;
+    return result;
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Сжатый список вхождений терма в документы.
+// Записи упорядочены по возрастанию id документа. Каждая запись кодируется
+// как varint-разность с предыдущим id и varint-число вхождений терма.
+// Каждые BLOCK_SIZE записей начинается новый блок; для блока запоминается
+// смещение в потоке байт и его последний id, что позволяет SkipTo и Find
+// перескакивать целые блоки без декодирования.
+// Вместе с записью передаётся её вес — верхняя оценка её вклада в релевантность
+// (для поискового сервера это TF). Для блоков и всего списка хранятся
+// максимумы весов, по которым работает динамическое отсечение (Block-Max WAND).
+// Закодированные байты не меняются: Append дописывает запись в конец,
+// а вставка в середину и удаление перестраивают список целиком.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    struct Posting {
+        int document_id = 0;
+        uint32_t term_count = 0;
+    };
+
+    // Заголовок блока. Раскладка без неявных пропусков, чтобы блоки можно было
+    // записывать в снимок как есть и читать прямо из отображённой памяти.
+    struct Block {
+        double max_weight = 0.0;
+        int base_id = 0;
+        int last_id = 0;
+        uint32_t offset = 0;
+        uint32_t reserved = 0;
+    };
+
+    // Сырые данные списка для записи в снимок и загрузки из него
+    struct RawData {
+        const uint8_t* data = nullptr;
+        size_t data_size = 0;
+        const Block* blocks = nullptr;
+        size_t block_count = 0;
+        size_t size = 0;
+        double max_weight = 0.0;
+    };
+
+    // Последний id и максимальный вес блока
+    struct BlockBound {
+        int last_document_id = std::numeric_limits<int>::max();
+        double max_weight = 0.0;
+    };
+
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Posting;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Posting*;
+        using reference = const Posting&;
+
+        Iterator() = default;
+
+        const Posting& operator*() const {
+            return current_;
+        }
+
+        const Posting* operator->() const {
+            return &current_;
+        }
+
+        Iterator& operator++();
+
+        Iterator operator++(int);
+
+        // Перемещает итератор на первую запись с id не меньше document_id
+        void SkipTo(int document_id);
+
+        // Граница блока, в котором окажется итератор после SkipTo(document_id).
+        // Сам итератор не сдвигается и ничего не декодирует. Если таких записей нет,
+        // возвращается блок с нулевым весом, не ограничивающий id.
+        BlockBound PeekBlock(int document_id) const;
+
+        bool operator==(const Iterator& other) const {
+            return list_ == other.list_ && position_ == other.position_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class PostingList;
+
+        Iterator(const PostingList* list, size_t position);
+
+        void SeekBlock(size_t block);
+        void DecodeNext(int previous_id);
+
+        const PostingList* list_ = nullptr;
+        const uint8_t* data_ = nullptr;
+        size_t position_ = 0;
+        size_t offset_ = 0;
+        Posting current_;
+    };
+
+    PostingList() = default;
+
+    // Дописывает запись в конец; document_id должен быть больше последнего
+    void Append(int document_id, uint32_t term_count, double weight);
+
+    // Добавляет запись в произвольное место (в середину — с перестроением списка)
+    void Insert(int document_id, uint32_t term_count, double weight);
+
+    // Удаляет запись документа, возвращает число удалённых записей, как std::map::erase
+    size_t Erase(int document_id);
+
+    Iterator Find(int document_id) const;
+
+    bool Contains(int document_id) const;
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    // Максимальный вес записей списка
+    double MaxWeight() const {
+        return max_weight_;
+    }
+
+    // Объём памяти в байтах, принадлежащей списку (внешняя память не учитывается)
+    size_t MemoryUsage() const;
+
+    // Отдаёт лишнюю ёмкость массивов, когда список больше не будет расти
+    void ShrinkToFit();
+
+    RawData GetRawData() const;
+
+    // Список, читающий байты и блоки прямо из внешней памяти, например из
+    // отображённого снимка; память должна жить дольше списка.
+    // Перед первым изменением список копирует данные к себе.
+    static PostingList FromRawData(const RawData& raw);
+
+private:
+    std::vector<uint8_t> data_;
+    std::vector<Block> blocks_;
+    // внешние данные; если заданы, data_ и blocks_ пусты
+    const uint8_t* external_data_ = nullptr;
+    size_t external_data_size_ = 0;
+    const Block* external_blocks_ = nullptr;
+    size_t external_block_count_ = 0;
+    size_t size_ = 0;
+    double max_weight_ = 0.0;
+
+    const uint8_t* Data() const {
+        return external_data_ != nullptr ? external_data_ : data_.data();
+    }
+
+    const Block* BlocksBegin() const {
+        return external_blocks_ != nullptr ? external_blocks_ : blocks_.data();
+    }
+
+    const Block* BlocksEnd() const {
+        return external_blocks_ != nullptr ? external_blocks_ + external_block_count_ : blocks_.data() + blocks_.size();
+    }
+
+    // Копирует внешние данные в собственные массивы
+    void Detach();
+
+    // Пересобирает список без записи erase_id и с записью insert.
+    // Точные веса записей неизвестны, поэтому каждой достаётся максимум
+    // её старого блока — это по-прежнему верхняя оценка.
+    struct WeightedPosting {
+        Posting posting;
+        double weight = 0.0;
+    };
+    PostingList Rebuild(std::optional<int> erase_id, std::optional<WeightedPosting> insert) const;
+
+    static void EncodeVarint(std::vector<uint8_t>& out, uint32_t value);
+    static uint32_t DecodeVarint(const uint8_t* data, size_t& offset);
+};
+
+static_assert(std::is_trivially_copyable_v<PostingList::Block> && sizeof(PostingList::Block) == 24,
+              "PostingList::Block is stored in snapshots byte for byte");
@@ -3,11 +3,49 @@
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-        return ProcessQueries(std::execution::seq, search_server, queries);
+        return ProcessQueries(std::execution::par, search_server, queries);
 }
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-        return ProcessQueriesJoined(std::execution::seq, search_server, queries);
-}
\ No newline at end of file
+        return ProcessQueriesJoined(std::execution::par, search_server, queries);
+}
+
+namespace {
+
+std::vector<std::vector<Document>> ProcessQueriesOnExecutor(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+        std::vector<std::vector<Document>> results(queries.size());
+        search_server.GetExecutor().ParallelFor(queries.size(), [&](size_t i) {
+            results[i] = search_server.FindTopDocuments(queries[i]);
+        });
+        return results;
+}
+
+}  // namespace
+
+std::future<std::vector<std::vector<Document>>> ProcessQueriesAsync(
+    const SearchServer& search_server,
+    std::vector<std::string> queries) {
+        return search_server.GetExecutor().Submit([&search_server, queries = std::move(queries)] {
+            return ProcessQueriesOnExecutor(search_server, queries);
+        });
+}
+
+void ProcessQueriesAsync(
+    const SearchServer& search_server,
+    std::vector<std::string> queries,
+    std::function<void(std::vector<std::vector<Document>> results, std::exception_ptr error)> callback) {
+        search_server.GetExecutor().Submit([&search_server, queries = std::move(queries), callback = std::move(callback)] {
+            std::vector<std::vector<Document>> results;
+            try {
+                results = ProcessQueriesOnExecutor(search_server, queries);
+            } catch (...) {
+                callback({}, std::current_exception());
+                return;
+            }
+            callback(std::move(results), nullptr);
+        });
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include <vector>
 #include <string>
 #include <functional>
@@ -6,23 +7,48 @@
 #include "search_server.h"
 #include "document.h"
 
+// Параллельная версия распределяет запросы по пулу сервера, если он задан,
+// и каждый запрос тоже считается на нём по диапазонам документов.
+// Без пула параллельны только запросы: вложенный std::execution::par
+// перегружал бы планировщик. Последовательна только версия с seq.
 template <typename ExecutionPolicy>
 std::vector<std::vector<Document>> ProcessQueries(
     ExecutionPolicy&& policy,
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
     std::vector<std::vector<Document>> results(queries.size());
-    std::transform(std::execution::par, std::begin(queries), std::end(queries), std::begin(results),
-                   [&search_server, policy](const std::string& query){
-                       return search_server.FindTopDocuments(policy, query);
+    ThreadPool* thread_pool = search_server.GetThreadPool();
+    if (thread_pool != nullptr
+        && !std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        thread_pool->ParallelFor(queries.size(), [&](size_t i) {
+            results[i] = search_server.FindTopDocuments(std::execution::par, queries[i]);
+        });
+        return results;
+    }
+    std::transform(policy, std::begin(queries), std::end(queries), std::begin(results),
+                   [&search_server](const std::string& query){
+                       return search_server.FindTopDocuments(std::execution::seq, query);
                    });
     return results;
 }
 
+// То же, что с std::execution::par
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries); 
 
+// Асинхронный пакет запросов на исполнителе сервера; запросы копируются.
+// Ошибка любого запроса приходит исключением из future::get.
+std::future<std::vector<std::vector<Document>>> ProcessQueriesAsync(
+    const SearchServer& search_server,
+    std::vector<std::string> queries);
+
+// То же с вызовом callback(results, error) на потоке исполнителя по завершении пакета
+void ProcessQueriesAsync(
+    const SearchServer& search_server,
+    std::vector<std::string> queries,
+    std::function<void(std::vector<std::vector<Document>> results, std::exception_ptr error)> callback);
+
 template <typename ExecutionPolicy>
 std::vector<Document> ProcessQueriesJoined(
     ExecutionPolicy&& policy,
@@ -45,6 +71,7 @@ std::vector<Document> ProcessQueriesJoined(
         return flat_results;                                  
 }
 
+// То же, что с std::execution::par
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
\ No newline at end of file
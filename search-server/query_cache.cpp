@@ -0,0 +1,80 @@
+#include "query_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+// накладные расходы записи: узел списка, узел хеш-таблицы и заголовки строки и вектора
+constexpr size_t ENTRY_OVERHEAD = 128;
+
+}  // namespace
+
+QueryCache::QueryCache(Options options) : options_(options) {
+    if (options_.shard_count == 0) {
+        throw std::invalid_argument("Query cache needs at least one shard");
+    }
+    for (size_t i = 0; i < options_.shard_count; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::optional<std::vector<Document>> QueryCache::Get(std::string_view key, uint64_t version) {
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        return std::nullopt;
+    }
+    if (it->second->version != version) {
+        Erase(shard, it->second);
+        ++shard.misses;
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    ++shard.hits;
+    return it->second->documents;
+}
+
+void QueryCache::Put(std::string key, uint64_t version, std::vector<Document> documents) {
+    const size_t bytes = ENTRY_OVERHEAD + key.size() + documents.size() * sizeof(Document);
+    const size_t shard_capacity = options_.capacity_bytes / shards_.size();
+    if (bytes > shard_capacity) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.mutex);
+    if (const auto it = shard.index.find(key); it != shard.index.end()) {
+        Erase(shard, it->second);
+    }
+    while (!shard.entries.empty() && shard.bytes + bytes > shard_capacity) {
+        Erase(shard, std::prev(shard.entries.end()));
+    }
+    shard.entries.push_front({std::move(key), version, std::move(documents), bytes});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.bytes += bytes;
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+    Stats stats;
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.entries += shard->entries.size();
+        stats.memory_bytes += shard->bytes;
+    }
+    return stats;
+}
+
+QueryCache::Shard& QueryCache::GetShard(std::string_view key) const {
+    return *shards_[std::hash<std::string_view>{}(key) % shards_.size()];
+}
+
+void QueryCache::Erase(Shard& shard, std::list<Entry>::iterator it) {
+    shard.bytes -= it->bytes;
+    shard.index.erase(it->key);
+    shard.entries.erase(it);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "document.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Кэш выдачи запросов: ключ — нормализованный запрос в виде строки байт,
+// значение — выдача и версия индекса, для которой она посчитана.
+// Запись с другой версией считается устаревшей и удаляется при обращении,
+// поэтому изменение индекса инвалидирует кэш одним увеличением версии.
+// Ключи распределены по независимым сегментам со своей блокировкой;
+// в каждом сегменте вытесняются давно не использованные записи (LRU),
+// когда их объём превышает его долю capacity_bytes.
+class QueryCache {
+public:
+    struct Options {
+        size_t capacity_bytes = 64 << 20;
+        size_t shard_count = 16;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        // оценка памяти под ключи, выдачу и служебные структуры
+        size_t memory_bytes = 0;
+
+        double GetHitRate() const {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    explicit QueryCache(Options options);
+
+    std::optional<std::vector<Document>> Get(std::string_view key, uint64_t version);
+
+    void Put(std::string key, uint64_t version, std::vector<Document> documents);
+
+    Stats GetStats() const;
+
+    const Options& GetOptions() const {
+        return options_;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t version = 0;
+        std::vector<Document> documents;
+        size_t bytes = 0;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // от недавно использованных к давно использованным
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    Options options_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    Shard& GetShard(std::string_view key) const;
+
+    static void Erase(Shard& shard, std::list<Entry>::iterator it);
+};
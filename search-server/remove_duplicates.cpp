@@ -1,22 +1,45 @@
 #include "remove_duplicates.h"
 
+#include <algorithm>
+#include <execution>
+#include <iostream>
+#include <utility>
+#include <vector>
+
 void RemoveDuplicates(SearchServer& search_server) {
-    std::set<int> duplicates_id;
-    std::map<std::set<std::string>, std::set<int>> work_base;
-        for (const int id : search_server) {
-            std::set<std::string> words_;
-            for (const auto& [words_from_doc, d] : search_server.GetWordFrequencies(id)) {
-                words_.insert(words_from_doc);
-            }
-            const int last_item = *(work_base[words_].end());
-            work_base[words_].insert(id);
-            if (work_base.at(words_).size() > 1) {
-                duplicates_id.insert(std::max(id, last_item));
-            }
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<std::pair<uint64_t, int>> fingerprints(document_ids.size());
+    std::transform(std::execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(),
+                   [&search_server](int document_id) {
+                       return std::pair{search_server.GetTermSetFingerprint(document_id), document_id};
+                   });
+    // документы с равными отпечатками оказываются рядом, в каждой группе — по возрастанию id
+    std::sort(std::execution::par, fingerprints.begin(), fingerprints.end());
+
+    std::vector<int> duplicates;
+    // первые документы группы с попарно различными множествами слов; больше одного — только при коллизии
+    std::vector<int> originals;
+    for (size_t begin = 0, end = 0; begin < fingerprints.size(); begin = end) {
+        while (end < fingerprints.size() && fingerprints[end].first == fingerprints[begin].first) {
+            ++end;
         }
-           
-        for (const int id : duplicates_id) {
-            std::cout << "Found duplicate document id " << id << std::endl;
-            search_server.RemoveDocument(id);
+        originals.clear();
+        for (size_t i = begin; i < end; ++i) {
+            const int document_id = fingerprints[i].second;
+            const bool is_duplicate = std::any_of(originals.begin(), originals.end(), [&](int original_id) {
+                return search_server.HasSameTerms(original_id, document_id);
+            });
+            if (is_duplicate) {
+                duplicates.push_back(document_id);
+            } else {
+                originals.push_back(document_id);
+            }
         }
+    }
+
+    std::sort(duplicates.begin(), duplicates.end());
+    for (const int document_id : duplicates) {
+        std::cout << "Found duplicate document id "s << document_id << '\n';
+    }
+    search_server.RemoveDocuments(duplicates);
 }
@@ -1,4 +1,8 @@
 #pragma once
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Удаляет документы, множество слов которых совпадает с множеством слов
+// документа с меньшим id, и печатает id удалённых по возрастанию.
+// Отпечатки документов считаются параллельно; совпадение отпечатков
+// проверяется точным сравнением слов, а дубликаты удаляются одним RemoveDocuments.
+void RemoveDuplicates(SearchServer& search_server);
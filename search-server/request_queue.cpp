@@ -1,17 +1,119 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_(search_server){}
+RequestQueue::RequestQueue(const SearchServer& search_server) : RequestQueue(search_server, Options{}) {
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, Options options)
+    : search_server_(search_server)
+    , options_(std::move(options))
+    , start_(options_.clock()) {
+    uint64_t capacity = 2;
+    while (capacity < options_.capacity) {
+        capacity *= 2;
+    }
+    slots_ = std::make_unique<Slot[]>(capacity);
+    for (uint64_t i = 0; i < capacity; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+        slots_[i].record.store(0, std::memory_order_relaxed);
+    }
+    mask_ = capacity - 1;
+}
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-        return RequestQueue::AddFindRequest(raw_query, [status](int, DocumentStatus document_status, int) {
-            return document_status == status;
-        });
+std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query, DocumentStatus status) {
+    std::vector<Document> result = search_server_.FindTopDocuments(raw_query, status);
+    Record(!result.empty());
+    return result;
 }
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-        return RequestQueue::AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query) {
+    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
 
 int RequestQueue::GetNoResultRequests() const {
-        return count_if(requests_.begin(), requests_.end(), [](const auto item){return item.founded == false;});
-}
\ No newline at end of file
+    Expire();
+    return static_cast<int>(std::max<int64_t>(no_result_count_.load(std::memory_order_acquire), 0));
+}
+
+int RequestQueue::GetRequestCount() const {
+    Expire();
+    return static_cast<int>(std::max<int64_t>(request_count_.load(std::memory_order_acquire), 0));
+}
+
+uint64_t RequestQueue::Now() const {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(options_.clock() - start_).count();
+    return elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0;
+}
+
+void RequestQueue::Record(bool has_result) {
+    const uint64_t record = Now() << 1 | (has_result ? 0 : 1);
+    // счётчики растут до публикации записи, чтобы её снятие не увело их в минус
+    request_count_.fetch_add(1, std::memory_order_relaxed);
+    if (!has_result) {
+        no_result_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t position = enqueue_position_.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots_[position & mask_];
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<int64_t>(sequence - position);
+        if (difference == 0) {
+            if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.record.store(record, std::memory_order_relaxed);
+                slot.sequence.store(position + 1, std::memory_order_release);
+                break;
+            }
+        } else if (difference < 0) {
+            // буфер полон: вытесняем самую старую запись
+            PopIf([](uint64_t) {
+                return true;
+            });
+            position = enqueue_position_.load(std::memory_order_relaxed);
+        } else {
+            position = enqueue_position_.load(std::memory_order_relaxed);
+        }
+    }
+    Expire();
+}
+
+template <typename Predicate>
+bool RequestQueue::PopIf(Predicate expired) const {
+    uint64_t position = dequeue_position_.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots_[position & mask_];
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<int64_t>(sequence - (position + 1));
+        if (difference < 0) {
+            return false;
+        }
+        if (difference > 0) {
+            position = dequeue_position_.load(std::memory_order_relaxed);
+            continue;
+        }
+        const uint64_t record = slot.record.load(std::memory_order_relaxed);
+        if (!expired(record)) {
+            return false;
+        }
+        if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+            request_count_.fetch_sub(1, std::memory_order_relaxed);
+            if (record & 1) {
+                no_result_count_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+    }
+}
+
+void RequestQueue::Expire() const {
+    // окно — полуинтервал (now - window, now]
+    const auto window = static_cast<uint64_t>(options_.window.count());
+    const uint64_t now = Now();
+    if (now < window) {
+        return;
+    }
+    const uint64_t deadline = now - window;
+    while (PopIf([deadline](uint64_t record) {
+        return (record >> 1) <= deadline;
+    })) {
+    }
+}
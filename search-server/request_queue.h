@@ -1,40 +1,77 @@
 #pragma once
 #include "search_server.h"
-#include <deque>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+// Счётчик запросов без результата за скользящее окно времени.
+// Запросы хранятся в кольцевом буфере фиксированных записей (время и признак
+// результата в одном слове, без текста запроса), который работает как
+// ограниченная очередь без блокировок для многих писателей и читателей:
+// AddFindRequest дописывает запись в конец, а записи старше окна снимаются
+// с начала при следующих обращениях. Число запросов в окне и число запросов
+// без результата поддерживаются счётчиками, поэтому GetNoResultRequests
+// не перебирает записи. Если буфер заполнен, вытесняется самая старая запись.
 class RequestQueue {
 public:
+    struct Options {
+        std::chrono::nanoseconds window = std::chrono::hours(24);
+        // округляется вверх до степени двойки
+        size_t capacity = 1 << 16;
+        // источник времени; подменяется в тестах
+        std::function<std::chrono::steady_clock::time_point()> clock = std::chrono::steady_clock::now;
+    };
+
     explicit RequestQueue(const SearchServer& search_server);
 
+    RequestQueue(const SearchServer& search_server, Options options);
+
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-            if (fooled_ || requests_.size() >= min_in_day_) {
-                requests_.pop_front();
-                fooled_ = true;
-            }
-            std::vector<Document> result = search_server_.FindTopDocuments(raw_query, document_predicate);
-            requests_.push_back({raw_query, !result.empty()});
-            return result;
-        }
+    std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate) {
+        std::vector<Document> result = search_server_.FindTopDocuments(raw_query, document_predicate);
+        Record(!result.empty());
+        return result;
+    }
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentStatus status);
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    std::vector<Document> AddFindRequest(std::string_view raw_query);
 
     int GetNoResultRequests() const;
 
+    int GetRequestCount() const;
+
 private:
-    struct QueryResult {
-        QueryResult() = default;
-        const std::string request;
-        bool founded;
+    struct Slot {
+        // номер позиции, для которой слот готов: pos — к записи, pos + 1 — к чтению
+        std::atomic<uint64_t> sequence;
+        // время в наносекундах от создания очереди, сдвинутое на бит, и признак результата
+        std::atomic<uint64_t> record;
     };
 
-    std::deque<QueryResult> requests_;
+    const SearchServer& search_server_;
+    Options options_;
+    std::chrono::steady_clock::time_point start_;
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t mask_;
+    // очередь логически константна: снятие устаревших записей не меняет ответов
+    mutable std::atomic<uint64_t> enqueue_position_ = 0;
+    mutable std::atomic<uint64_t> dequeue_position_ = 0;
+    mutable std::atomic<int64_t> request_count_ = 0;
+    mutable std::atomic<int64_t> no_result_count_ = 0;
+
+    uint64_t Now() const;
 
-    const static int min_in_day_ = 1440;
+    void Record(bool has_result);
 
-    const SearchServer& search_server_;
+    // Снимает с начала одну запись, если expired(record) истинно; возвращает, снята ли она
+    template <typename Predicate>
+    bool PopIf(Predicate expired) const;
 
-    bool fooled_ = false;
-}; 
\ No newline at end of file
+    // Снимает записи старше окна
+    void Expire() const;
+};
@@ -0,0 +1,45 @@
+#include "score_accumulator.h"
+
+namespace {
+
+struct ThreadAccumulator {
+    ScoreAccumulator accumulator;
+    bool busy = false;
+};
+
+thread_local ThreadAccumulator thread_accumulator;
+
+}  // namespace
+
+ScoreAccumulator::Lease::Lease(size_t document_count) {
+    if (thread_accumulator.busy) {
+        temporary_ = std::make_unique<ScoreAccumulator>();
+        accumulator_ = temporary_.get();
+    } else {
+        thread_accumulator.busy = true;
+        accumulator_ = &thread_accumulator.accumulator;
+    }
+    accumulator_->Resize(document_count);
+}
+
+ScoreAccumulator::Lease::~Lease() {
+    accumulator_->Clear();
+    if (!temporary_) {
+        thread_accumulator.busy = false;
+    }
+}
+
+void ScoreAccumulator::Resize(size_t document_count) {
+    if (scores_.size() < document_count) {
+        scores_.resize(document_count, 0.0);
+        states_.resize(document_count, State::UNTOUCHED);
+    }
+}
+
+void ScoreAccumulator::Clear() {
+    for (const uint32_t ordinal : touched_) {
+        scores_[ordinal] = 0.0;
+        states_[ordinal] = State::UNTOUCHED;
+    }
+    touched_.clear();
+}
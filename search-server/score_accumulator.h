@@ -0,0 +1,106 @@
+#pragma once
+#include "posting_list.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Накопитель релевантности, индексированный порядковыми номерами документов.
+// Массивы переиспользуются между запросами: после запроса обнуляются
+// только затронутые ячейки, номера которых собраны в touched_.
+// Вместе с накопителем переиспользуются и рабочие массивы Block-Max WAND,
+// поэтому прогретый запрос не выделяет памяти на подсчёт релевантности.
+class ScoreAccumulator {
+public:
+    enum class State : uint8_t {
+        UNTOUCHED,
+        SCORED,
+        EXCLUDED,
+    };
+
+    // Накопитель текущего потока на время одного запроса.
+    // Если он уже занят (вложенный запрос на том же потоке), выдаётся временный.
+    class Lease {
+    public:
+        explicit Lease(size_t document_count);
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ScoreAccumulator& operator*() const {
+            return *accumulator_;
+        }
+
+        ScoreAccumulator* operator->() const {
+            return accumulator_;
+        }
+
+    private:
+        ScoreAccumulator* accumulator_;
+        std::unique_ptr<ScoreAccumulator> temporary_;
+    };
+
+    // Курсор Block-Max WAND по списку вхождений плюс-слова. Вклад записи
+    // в релевантность — её вес (TF), умноженный на IDF, поэтому IDF * максимальный
+    // вес ограничивает сверху вклад любой записи списка или блока.
+    struct WandCursor {
+        PostingList::Iterator it;
+        PostingList::Iterator end;
+        size_t term_index = 0;
+        double inverse_document_freq = 0.0;
+        double max_score = 0.0;
+        // текущий порядковый номер; конец диапазона — курсор исчерпан
+        int64_t ordinal = 0;
+    };
+
+    struct WandBuffers {
+        std::vector<WandCursor> cursors;
+        // курсоры, упорядоченные по текущему номеру
+        std::vector<WandCursor*> order;
+        // вклады плюс-слов в релевантность текущего документа
+        std::vector<double> contributions;
+    };
+
+    void Resize(size_t document_count);
+
+    WandBuffers& GetWandBuffers() {
+        return wand_buffers_;
+    }
+
+    State GetState(uint32_t ordinal) const {
+        return states_[ordinal];
+    }
+
+    void Add(uint32_t ordinal, double value) {
+        if (states_[ordinal] == State::UNTOUCHED) {
+            states_[ordinal] = State::SCORED;
+            touched_.push_back(ordinal);
+        }
+        scores_[ordinal] += value;
+    }
+
+    // Исключает документ из выдачи: дальнейшие Add для него не нужны
+    void Exclude(uint32_t ordinal) {
+        if (states_[ordinal] == State::UNTOUCHED) {
+            touched_.push_back(ordinal);
+        }
+        states_[ordinal] = State::EXCLUDED;
+    }
+
+    template <typename Callback>
+    void ForEachScored(Callback callback) const {
+        for (const uint32_t ordinal : touched_) {
+            if (states_[ordinal] == State::SCORED) {
+                callback(ordinal, scores_[ordinal]);
+            }
+        }
+    }
+
+    void Clear();
+
+private:
+    std::vector<double> scores_;
+    std::vector<State> states_;
+    std::vector<uint32_t> touched_;
+    WandBuffers wand_buffers_;
+};
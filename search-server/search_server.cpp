@@ -1,5 +1,10 @@
 #include "search_server.h"
 
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <unordered_set>
+
 SearchServer::SearchServer(const std::string& stop_words_text): 
     raw_stop_words_(stop_words_text),
     stop_words_(MakeUniqueNonEmptyStrings(SplitIntoWords(raw_stop_words_))) {
@@ -9,61 +14,542 @@ SearchServer::SearchServer(const std::string& stop_words_text):
     }  
 
 void SearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status, const std::vector<int>& ratings) {
-        if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+        if ((document_id < 0) || (id_to_ordinal_.count(document_id) > 0)) {
             throw std::invalid_argument("Invalid document_id"s);
         }
-        raw_documents_text_.insert(std::string(document));
-        const auto words = SplitIntoWordsNoStop(*find(raw_documents_text_.begin(), raw_documents_text_.end(), std::string(document)));
+        if (static_cast<size_t>(status) >= STATUS_COUNT) {
+            throw std::invalid_argument("Invalid document status"s);
+        }
+        // словарь хранит копии слов, поэтому разбирать можно сам переданный текст
+        const auto words = SplitIntoWordsNoStop(document);
+        if (near_duplicates_ && near_duplicates_->GetOptions().reject_on_insert && IsNearDuplicate(words)) {
+            ++rejected_near_duplicates_;
+            return;
+        }
+        LogAddDocument(document_id, document, status, ratings);
+        InstallMerge(false);
         
         const double inv_word_count = 1.0 / words.size();
+        std::map<TermId, uint32_t> term_counts;
         for (const std::string_view& word : words) {
-            word_to_document_freqs_[word][document_id] += inv_word_count;
-            document_to_word_freqs_[document_id][word] += inv_word_count;
+            ++term_counts[terms_.Intern(word)];
         }
-        documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+        IndexSegment& segment = GetOpenSegment();
+        const DocumentOrdinal ordinal = segment.AppendDocument(inv_word_count);
+        segment.ResizeTerms(terms_.size());
+        term_document_counts_.resize(terms_.size());
+        idf_cache_.Resize(terms_.size());
+        auto& document_terms = document_terms_.emplace_back();
+        document_terms.reserve(term_counts.size());
+        for (const auto [term_id, term_count] : term_counts) {
+            segment.GetMutablePostings(term_id).Append(ordinal, term_count, term_count * inv_word_count);
+            ++term_document_counts_[term_id];
+            document_terms.push_back({term_id, term_count});
+        }
+        documents_.push_back({document_id, status, inv_word_count, documents_text_.Add(document)});
+        ratings_.Append(ComputeAverageRating(ratings));
+        id_to_ordinal_.emplace(document_id, ordinal);
         document_ids_.insert(document_id);
+        SetStatusBit(ordinal, status, true);
+        idf_cache_.Invalidate();
+        ++index_version_;
+        if (near_duplicates_) {
+            IndexNearDuplicates(*near_duplicates_, ordinal, ordinal + 1);
+        }
+        SealOpenSegmentIfFull();
 }  
     
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, [status](int, DocumentStatus document_status, int) {
-        return document_status == status;
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    std::unordered_set<int> batch_ids;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0 || id_to_ordinal_.count(document.id) > 0 || !batch_ids.insert(document.id).second) {
+            throw std::invalid_argument("Invalid document_id"s);
+        }
+        if (static_cast<size_t>(document.status) >= STATUS_COUNT) {
+            throw std::invalid_argument("Invalid document status"s);
+        }
+    }
+    if (near_duplicates_ && near_duplicates_->GetOptions().reject_on_insert) {
+        // документы сверяются и с документами пакета перед ними, поэтому добавляются по одному;
+        // ошибки в текстах, как и в общем случае, обнаруживаются до изменения индекса
+        for (const NewDocument& document : documents) {
+            SplitIntoWordsNoStop(document.text);
+        }
+        for (const NewDocument& document : documents) {
+            AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        return;
+    }
+
+    // Разбор текстов: уникальные слова документа в порядке первого появления,
+    // чтобы словарь раздал термам те же id, что и последовательный AddDocument
+    struct ParsedDocument {
+        std::vector<std::pair<std::string_view, uint32_t>> word_counts;
+        double inv_word_count = 0.0;
+        std::exception_ptr error;
+    };
+    std::vector<ParsedDocument> parsed(documents.size());
+    std::vector<size_t> indexes(documents.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        // исключение из параллельного алгоритма завершило бы программу
+        try {
+            const auto words = SplitIntoWordsNoStop(documents[i].text);
+            std::unordered_map<std::string_view, size_t> word_positions;
+            for (const std::string_view word : words) {
+                const auto [it, inserted] = word_positions.emplace(word, parsed[i].word_counts.size());
+                if (inserted) {
+                    parsed[i].word_counts.push_back({word, 1});
+                } else {
+                    ++parsed[i].word_counts[it->second].second;
+                }
+            }
+            parsed[i].inv_word_count = 1.0 / words.size();
+        } catch (...) {
+            parsed[i].error = std::current_exception();
+        }
+    });
+    for (const ParsedDocument& document : parsed) {
+        if (document.error) {
+            std::rethrow_exception(document.error);
+        }
+    }
+    for (const NewDocument& document : documents) {
+        LogAddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    InstallMerge(false);
+
+    // Словарь не потокобезопасен, поэтому id термам раздаются последовательно
+    const auto first_ordinal = static_cast<DocumentOrdinal>(documents_.size());
+    document_terms_.resize(first_ordinal + documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        auto& document_terms = document_terms_[first_ordinal + i];
+        document_terms.reserve(parsed[i].word_counts.size());
+        for (const auto& [word, term_count] : parsed[i].word_counts) {
+            document_terms.push_back({terms_.Intern(word), term_count});
+        }
+    }
+    // пакет целиком ложится в открытый сегмент и запечатывается после него
+    IndexSegment& segment = GetOpenSegment();
+    for (const ParsedDocument& document : parsed) {
+        segment.AppendDocument(document.inv_word_count);
+    }
+    segment.ResizeTerms(terms_.size());
+    term_document_counts_.resize(terms_.size());
+    idf_cache_.Resize(terms_.size());
+
+    // Каждая часть пакета строит свои записи вхождений, упорядоченные по терму,
+    // а внутри терма — по порядковому номеру документа
+    struct PartialPosting {
+        TermId term_id;
+        DocumentOrdinal ordinal;
+        uint32_t term_count;
+        double weight;
+    };
+    const size_t chunk_count = std::clamp<size_t>((documents.size() + MIN_INDEXING_CHUNK - 1) / MIN_INDEXING_CHUNK,
+                                                  1, 4 * std::max(1u, std::thread::hardware_concurrency()));
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    std::vector<std::vector<PartialPosting>> partial_postings(chunk_count);
+    std::vector<size_t> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+        auto& postings = partial_postings[chunk];
+        const size_t last = std::min(documents.size(), (chunk + 1) * chunk_size);
+        for (size_t i = chunk * chunk_size; i < last; ++i) {
+            const auto ordinal = static_cast<DocumentOrdinal>(first_ordinal + i);
+            auto& document_terms = document_terms_[ordinal];
+            std::sort(document_terms.begin(), document_terms.end(), [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+                return lhs.term_id < rhs.term_id;
+            });
+            for (const DocumentTerm& term : document_terms) {
+                postings.push_back({term.term_id, ordinal, term.term_count, term.term_count * parsed[i].inv_word_count});
+            }
+        }
+        std::stable_sort(postings.begin(), postings.end(), [](const PartialPosting& lhs, const PartialPosting& rhs) {
+            return lhs.term_id < rhs.term_id;
+        });
     });
+
+    // Слияние: диапазоны термов независимы, каждый дописывает свои списки
+    // из частей по порядку, так что номера документов в списке возрастают
+    const size_t term_count = terms_.size();
+    const size_t term_range_size = (term_count + chunk_count - 1) / chunk_count;
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t range) {
+        const auto first_term = static_cast<TermId>(std::min(term_count, range * term_range_size));
+        const auto last_term = static_cast<TermId>(std::min(term_count, (range + 1) * term_range_size));
+        for (const auto& postings : partial_postings) {
+            auto it = std::lower_bound(postings.begin(), postings.end(), first_term, [](const PartialPosting& posting, TermId term_id) {
+                return posting.term_id < term_id;
+            });
+            for (; it != postings.end() && it->term_id < last_term; ++it) {
+                segment.GetMutablePostings(it->term_id).Append(it->ordinal, it->term_count, it->weight);
+                ++term_document_counts_[it->term_id];
+            }
+        }
+    });
+
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const NewDocument& document = documents[i];
+        documents_.push_back({document.id, document.status, parsed[i].inv_word_count, documents_text_.Add(document.text)});
+        ratings_.Append(ComputeAverageRating(document.ratings));
+        id_to_ordinal_.emplace(document.id, static_cast<DocumentOrdinal>(first_ordinal + i));
+        document_ids_.insert(document.id);
+        SetStatusBit(static_cast<DocumentOrdinal>(first_ordinal + i), document.status, true);
+    }
+    idf_cache_.Invalidate();
+    ++index_version_;
+    if (near_duplicates_) {
+        IndexNearDuplicates(*near_duplicates_, first_ordinal, static_cast<DocumentOrdinal>(documents_.size()));
+    }
+    SealOpenSegmentIfFull();
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status, size_t top_k) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, top_k);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, const DocumentFilter& filter, size_t top_k) const {
+    return FindTopDocuments(std::execution::seq, raw_query, filter, top_k);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query) const {
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentStatus status,
+                                                                       size_t top_k) const {
+    return GetExecutor().Submit([this, raw_query = std::move(raw_query), status, top_k] {
+        return FindTopDocuments(raw_query, status, top_k);
+    });
+}
+
+void SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentStatus status, size_t top_k,
+                                         SearchCallback callback) const {
+    GetExecutor().Submit([this, raw_query = std::move(raw_query), status, top_k, callback = std::move(callback)] {
+        std::vector<Document> documents;
+        try {
+            documents = FindTopDocuments(raw_query, status, top_k);
+        } catch (...) {
+            callback({}, std::current_exception());
+            return;
+        }
+        callback(std::move(documents), nullptr);
+    });
+}
+
 int SearchServer::GetDocumentCount() const {
-        return documents_.size();
+        return document_ids_.size();
+}
+
+void SearchServer::SetSegmentOptions(const SegmentOptions& options) {
+    if (options.seal_document_count == 0 || options.merge_factor < 2 || !(options.max_tombstone_ratio >= 0.0)) {
+        throw std::invalid_argument("Invalid segment options"s);
+    }
+    segment_options_ = options;
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    return segments_.size();
+}
+
+void SearchServer::WaitForMerges() {
+    // установка слияния может запустить следующее
+    while (pending_merge_) {
+        InstallMerge(true);
+    }
+}
+
+void SearchServer::SetThreadPool(std::shared_ptr<ThreadPool> thread_pool) {
+    thread_pool_ = std::move(thread_pool);
+}
+
+ThreadPool* SearchServer::GetThreadPool() const {
+    return thread_pool_.get();
+}
+
+ThreadPool& SearchServer::GetExecutor() const {
+    return thread_pool_ ? *thread_pool_ : ThreadPool::GetDefault();
+}
+
+void SearchServer::EnableQueryCache(const QueryCache::Options& options) {
+    query_cache_ = std::make_unique<QueryCache>(options);
+}
+
+void SearchServer::DisableQueryCache() {
+    query_cache_.reset();
+}
+
+QueryCache::Stats SearchServer::GetQueryCacheStats() const {
+    return query_cache_ ? query_cache_->GetStats() : QueryCache::Stats{};
+}
+
+IndexSegment& SearchServer::GetOpenSegment() {
+    if (segments_.empty() || segments_.back()->IsSealed()) {
+        segments_.push_back(std::make_shared<IndexSegment>(static_cast<DocumentOrdinal>(documents_.size())));
+    }
+    return *segments_.back();
+}
+
+void SearchServer::SealOpenSegmentIfFull() {
+    if (segments_.empty() || segments_.back()->IsSealed()
+        || segments_.back()->GetDocumentCount() < segment_options_.seal_document_count) {
+        return;
+    }
+    segments_.back()->Seal();
+    ScheduleMerge();
+}
+
+void SearchServer::ScheduleMerge() {
+    if (pending_merge_) {
+        return;
+    }
+    // ярус k — в сегменте не меньше половины seal_document_count * merge_factor^k
+    // неудалённых документов; половина оставляет слитый сегмент ярусом выше
+    // входных, даже если часть их документов удалена
+    auto tier = [this](const IndexSegment& segment) {
+        size_t result = 0;
+        for (size_t size = segment_options_.seal_document_count * segment_options_.merge_factor / 2;
+             size <= segment.GetLiveDocumentCount(); size *= segment_options_.merge_factor) {
+            ++result;
+        }
+        return result;
+    };
+    // ищем подряд идущие запечатанные сегменты одного яруса, начиная с младшего яруса
+    std::optional<std::pair<size_t, size_t>> best;  // ярус, первый сегмент
+    size_t run_begin = 0;
+    for (size_t i = 0; i < segments_.size() && segments_[i]->IsSealed(); ++i) {
+        if (i > run_begin && tier(*segments_[i]) != tier(*segments_[run_begin])) {
+            run_begin = i;
+        }
+        if (i + 1 - run_begin == segment_options_.merge_factor) {
+            const size_t run_tier = tier(*segments_[run_begin]);
+            if (!best || run_tier < best->first) {
+                best = {run_tier, run_begin};
+            }
+            run_begin = i + 1;
+        }
+    }
+    size_t first_segment = 0;
+    size_t segment_count = segment_options_.merge_factor;
+    if (best) {
+        first_segment = best->second;
+    } else {
+        // слить нечего — переписываем сегмент, больше всех заросший удалёнными записями
+        std::optional<size_t> most_deleted;
+        for (size_t i = 0; i < segments_.size() && segments_[i]->IsSealed(); ++i) {
+            if (segments_[i]->GetTombstoneRatio() > segment_options_.max_tombstone_ratio
+                && (!most_deleted || segments_[i]->GetTombstoneRatio() > segments_[*most_deleted]->GetTombstoneRatio())) {
+                most_deleted = i;
+            }
+        }
+        if (!most_deleted) {
+            return;
+        }
+        first_segment = *most_deleted;
+        segment_count = 1;
+    }
+
+    PendingMerge merge;
+    merge.first_segment = first_segment;
+    std::vector<std::vector<uint64_t>> deleted_bits;
+    for (size_t i = 0; i < segment_count; ++i) {
+        merge.inputs.push_back(segments_[merge.first_segment + i]);
+        deleted_bits.push_back(segments_[merge.first_segment + i]->GetDeletedBits());
+    }
+    // запечатанные сегменты не меняются, а отметки об удалении переданы копией,
+    // так что слияние не пересекается с изменениями индекса; отображение снимка,
+    // из которого могут читаться списки входных сегментов, живёт до конца слияния
+    merge.result = std::async(segment_options_.background_merge ? std::launch::async : std::launch::deferred,
+                              [inputs = merge.inputs, deleted_bits = std::move(deleted_bits), snapshot = snapshot_] {
+                                  return IndexSegment::Merge(inputs, deleted_bits);
+                              });
+    pending_merge_ = std::move(merge);
+    if (!segment_options_.background_merge) {
+        InstallMerge(true);
+    }
+}
+
+void SearchServer::InstallMerge(bool wait) {
+    if (!pending_merge_) {
+        return;
+    }
+    auto& result = pending_merge_->result;
+    if (!wait && result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    std::shared_ptr<IndexSegment> merged = result.get();
+    const auto first = segments_.begin() + pending_merge_->first_segment;
+    const auto last = first + pending_merge_->inputs.size();
+    // документы, удалённые уже во время слияния, отмечаются в результате
+    for (auto it = first; it != last; ++it) {
+        merged->CopyDeletedFrom(**it);
+    }
+    segments_.erase(first + 1, last);
+    segments_[pending_merge_->first_segment] = std::move(merged);
+    ++(pending_merge_->inputs.size() == 1 ? compaction_count_ : merge_count_);
+    pending_merge_.reset();
+    // слияние могло собрать очередную группу старшего яруса
+    ScheduleMerge();
+}
+
+IndexSegment& SearchServer::FindSegment(DocumentOrdinal ordinal) {
+    const auto it = std::upper_bound(segments_.begin(), segments_.end(), ordinal,
+                                     [](DocumentOrdinal value, const std::shared_ptr<IndexSegment>& segment) {
+                                         return value < segment->GetLastOrdinal();
+                                     });
+    return **it;
+}
+
+void SearchServer::MarkDocumentDeleted(DocumentOrdinal ordinal) {
+    InstallMerge(false);
+    IndexSegment& segment = FindSegment(ordinal);
+    segment.MarkDeleted(ordinal);
+    ++index_version_;
+    if (segment.IsSealed() && segment.GetTombstoneRatio() > segment_options_.max_tombstone_ratio) {
+        ScheduleMerge();
+    }
+}
+
+void SearchServer::ForgetDocument(DocumentOrdinal ordinal) {
+    const int document_id = documents_[ordinal].id;
+    for (const DocumentTerm& term : document_terms_[ordinal]) {
+        --term_document_counts_[term.term_id];
+    }
+    SetStatusBit(ordinal, documents_[ordinal].status, false);
+    if (near_duplicates_) {
+        near_duplicates_->Remove(document_id);
+    }
+    document_ids_.erase(document_id);
+    id_to_ordinal_.erase(document_id);
+    documents_text_.Release(documents_[ordinal].text_id);
+    std::vector<DocumentTerm>().swap(document_terms_[ordinal]);
+}
+
+void SearchServer::SetStatusBit(DocumentOrdinal ordinal, DocumentStatus status, bool value) {
+    auto& bits = status_documents_[static_cast<size_t>(status)];
+    if (bits.size() <= ordinal / 64) {
+        // карты всех статусов покрывают одни и те же номера
+        for (auto& status_bits : status_documents_) {
+            status_bits.resize(ordinal / 64 + 1, 0);
+        }
+    }
+    const uint64_t bit = uint64_t{1} << (ordinal % 64);
+    bits[ordinal / 64] = value ? bits[ordinal / 64] | bit : bits[ordinal / 64] & ~bit;
+}
+
+const std::vector<uint64_t>& SearchServer::GetStatusDocuments(DocumentStatus status) const {
+    if (static_cast<size_t>(status) >= STATUS_COUNT) {
+        throw std::invalid_argument("Invalid document status"s);
+    }
+    return status_documents_[static_cast<size_t>(status)];
+}
+
+void SearchServer::CompileFilter(const DocumentFilter& filter, QueryBuffers& buffers) const {
+    const size_t word_count = (documents_.size() + 63) / 64;
+    auto& bits = buffers.filter_bits;
+    if (filter.status) {
+        const auto& status_bits = GetStatusDocuments(*filter.status);
+        bits.assign(status_bits.begin(), status_bits.end());
+        bits.resize(word_count, 0);
+    } else {
+        // карты статусов не пересекаются, их объединение — все неудалённые документы
+        bits.assign(word_count, 0);
+        for (const auto& status_bits : status_documents_) {
+            for (size_t i = 0; i < std::min(word_count, status_bits.size()); ++i) {
+                bits[i] |= status_bits[i];
+            }
+        }
+    }
+    if (filter.min_rating != std::numeric_limits<int>::min() || filter.max_rating != std::numeric_limits<int>::max()) {
+        ratings_.CollectRange(filter.min_rating, filter.max_rating, buffers.rating_bits);
+        for (size_t i = 0; i < word_count; ++i) {
+            bits[i] &= buffers.rating_bits[i];
+        }
+    }
+}
+
+bool SearchServer::HasBitsInRange(const std::vector<uint64_t>& bits, DocumentOrdinal first, DocumentOrdinal last) {
+    for (DocumentOrdinal ordinal = first; ordinal < last;) {
+        const size_t word = ordinal / 64;
+        if (word >= bits.size()) {
+            return false;
+        }
+        // биты слова от ordinal % 64 до конца слова или до last
+        uint64_t mask = ~uint64_t{0} << (ordinal % 64);
+        const DocumentOrdinal word_end = static_cast<DocumentOrdinal>((word + 1) * 64);
+        if (last < word_end) {
+            mask &= (uint64_t{1} << (last % 64)) - 1;
+        }
+        if (bits[word] & mask) {
+            return true;
+        }
+        ordinal = word_end;
+    }
+    return false;
+}
+
+SearchServer::DeletionStats SearchServer::GetDeletionStats() const {
+    DeletionStats stats;
+    for (const auto& segment : segments_) {
+        stats.live_documents += segment->GetLiveDocumentCount();
+        stats.tombstones += segment->GetTombstoneCount();
+    }
+    stats.merges = merge_count_;
+    stats.compactions = compaction_count_;
+    return stats;
+}
+
+size_t SearchServer::GetPostingCount(TermId term_id) const {
+    size_t result = 0;
+    for (const auto& segment : segments_) {
+        result += segment->GetPostings(term_id).size();
+    }
+    return result;
+}
+
+void SearchServer::SetRetrievalMode(RetrievalMode mode) {
+    retrieval_mode_ = mode;
+}
+
+RetrievalMode SearchServer::GetRetrievalMode() const {
+    return retrieval_mode_;
+}
+
+SearchServer::RetrievalStats SearchServer::GetRetrievalStats() const {
+    return {postings_scored_.load(std::memory_order_relaxed), postings_skipped_.load(std::memory_order_relaxed)};
+}
+
+void SearchServer::ResetRetrievalStats() {
+    postings_scored_.store(0, std::memory_order_relaxed);
+    postings_skipped_.store(0, std::memory_order_relaxed);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view& raw_query, int document_id) const {
-        auto query = std::move(ParseQuery(raw_query));    
-        auto& plus = query.plus_words;
-        auto& minus = query.minus_words;
-        const auto& words_freq = word_to_document_freqs_;
+        QueryLease lease;
+        const Query& query = ParseQuery(raw_query, lease);
+        const auto& plus = query.plus_terms;
+        const auto& minus = query.minus_terms;
+        const DocumentOrdinal ordinal = id_to_ordinal_.at(document_id);
+        const auto& document_terms = document_terms_[ordinal];
         std::vector<std::string_view> matched_words;
 
         bool minus_check = std::any_of(std::execution::seq,
                                        std::begin(minus),
                                        std::end(minus),
-                                       [document_id, &words_freq](const std::string_view& word){
-                                           return (words_freq.at(word).count(document_id));
+                                       [&document_terms](const TermId term_id){
+                                           return DocumentHasTerm(document_terms, term_id);
                                        });
         if (!minus_check){
             matched_words.reserve(plus.size());
-            for (const std::string_view& word : plus) {
-                if (word_to_document_freqs_.count(word) == 0 || stop_words_.count(word)) {
-                    continue;
-                }
-                if (word_to_document_freqs_.at(word).count(document_id)) {
-                    matched_words.push_back(word);
+            for (const TermId term_id : plus) {
+                if (DocumentHasTerm(document_terms, term_id)) {
+                    matched_words.push_back(terms_.GetWord(term_id));
                 }
             }
+            std::sort(std::begin(matched_words), std::end(matched_words));
         }
     
-    return {matched_words, documents_.at(document_id).status};
+    return {std::move(matched_words), documents_[ordinal].status};
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy, const std::string_view& raw_query, int document_id) const {
@@ -71,42 +557,8 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy, const std::string_view& raw_query, int document_id) const {
-        auto query = std::move(ParseQuery(std::execution::par, raw_query));    
-        auto& plus = query.plus_words;
-        auto& minus = query.minus_words;
-        const auto& words_freq = word_to_document_freqs_;
-        std::vector<std::string_view> matched_words;
-        bool minus_check = std::any_of(std::execution::seq,
-                                       std::begin(minus),
-                                       std::end(minus),
-                                       [document_id, &words_freq](const std::string_view& word){
-                                           return (words_freq.at(word).count(document_id));
-                                       });
-    
-        if (!minus_check && plus.size()) {
-            matched_words.reserve(plus.size());
-            std::copy_if(std::execution::seq,
-                         std::begin(plus),
-                         std::end(plus),
-                         std::back_inserter(matched_words),
-                         [this, &words_freq, document_id]
-                         (const std::string_view& word){
-                             return (words_freq.at(word).count(document_id));
-                         }
-            );
-       
-        if (matched_words.size()) {
-            std::sort(std::execution::seq,
-                     std::begin(matched_words),
-                     std::end(matched_words));
-            auto it = std::unique(std::execution::seq,
-                                 std::begin(matched_words),
-                                 std::end(matched_words));
-            matched_words.resize(std::distance(matched_words.begin(), it));
-        }
-     }   
- 
-    return {matched_words, documents_.at(document_id).status};
+    // термы запроса уже без повторов, так что отдельной дедупликации слов не нужно
+    return MatchDocument(raw_query, document_id);
 }
 
 bool SearchServer::IsStopWord(const std::string_view& word) const {
@@ -121,14 +573,14 @@ bool SearchServer::IsValidWord(const std::string_view& word) {
 
 std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text) const {
         std::vector<std::string_view> words;
-        for (const std::string_view& word : SplitIntoWords(text)) {
-            if (!IsValidWord(word)) {
-                throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
-            }
-            if (!IsStopWord(word)) {
-                words.push_back(word);
-            }
+        if (!SplitIntoWords(text, words)) {
+            // медленный путь только ради текста ошибки
+            const auto it = std::find_if_not(words.begin(), words.end(), IsValidWord);
+            throw std::invalid_argument("Word "s + std::string(*it) + " is invalid"s);
         }
+        words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+            return IsStopWord(word);
+        }), words.end());
         return words;
 }
 
@@ -153,68 +605,104 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& tex
             is_minus = true;
             word = word.substr(1);
         }
-        if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+        if (word.empty() || word[0] == '-') {
             throw std::invalid_argument("Query word is invalid"s);
         }
 
-        return {word, is_minus, IsStopWord(word)};
+        return {word, is_minus};
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const {
-        SearchServer::Query result;
-        for (const std::string_view& word : SplitIntoWords(text)) {
-            const auto query_word = ParseQueryWord(word);
-            if (!query_word.is_stop) {
-                if (query_word.is_minus) {
-                    result.minus_words.push_back(query_word.data);
-                } else {
-                    result.plus_words.push_back(query_word.data);
-                }
-            }
-        }
-    {
-            std::sort(std::execution::seq,
-                     std::begin(result.plus_words),
-                     std::end(result.plus_words));
-            auto it = std::unique(std::execution::seq,
-                                 std::begin(result.plus_words),
-                                 std::end(result.plus_words));
-            result.plus_words.resize(std::distance(result.plus_words.begin(), it));
-    }
-    {
-            std::sort(std::execution::seq,
-                     std::begin(result.minus_words),
-                     std::end(result.minus_words));
-            auto it = std::unique(std::execution::seq,
-                                 std::begin(result.minus_words),
-                                 std::end(result.minus_words));
-            result.minus_words.resize(std::distance(result.minus_words.begin(), it));
+SearchServer::QueryLease::QueryLease() {
+    ThreadBuffers& thread_buffers = GetThreadBuffers();
+    if (thread_buffers.busy) {
+        temporary_ = std::make_unique<QueryBuffers>();
+        buffers_ = temporary_.get();
+    } else {
+        thread_buffers.busy = true;
+        buffers_ = &thread_buffers.buffers;
+    }
+}
+
+SearchServer::QueryLease::~QueryLease() {
+    if (!temporary_) {
+        GetThreadBuffers().busy = false;
     }
-        return result;
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::execution::sequenced_policy, const std::string_view& text) const {
-        return ParseQuery(text);
+SearchServer::QueryLease::ThreadBuffers& SearchServer::QueryLease::GetThreadBuffers() {
+    thread_local ThreadBuffers thread_buffers;
+    return thread_buffers;
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::execution::parallel_policy, const std::string_view& text) const {
-        SearchServer::Query result;
-        for (const std::string_view& word : SplitIntoWords(text)) {
-            const auto query_word = ParseQueryWord(word);
-            if (!query_word.is_stop) {
-                if (query_word.is_minus) {
-                    result.minus_words.push_back(query_word.data);
-                } else {
-                    result.plus_words.push_back(query_word.data);
-                }
-            }
+const SearchServer::Query& SearchServer::ParseQuery(const std::string_view& text, QueryLease& lease) const {
+    QueryBuffers& buffers = *lease;
+    Query& result = buffers.query;
+    buffers.words.clear();
+    result.plus_terms.clear();
+    result.minus_terms.clear();
+    // управляющие символы проверяются заодно с разбиением на слова
+    if (!SplitIntoWords(text, buffers.words)) {
+        throw std::invalid_argument("Query word is invalid"s);
+    }
+    for (const std::string_view& word : buffers.words) {
+        const auto query_word = ParseQueryWord(word);
+        const auto term_id = terms_.Find(query_word.data);
+        if (!term_id) {
+            continue;
         }
-                    
-        return result;
+        if (query_word.is_minus) {
+            result.minus_terms.push_back(*term_id);
+        } else {
+            result.plus_terms.push_back(*term_id);
+        }
+    }
+    for (std::vector<TermId>* terms : {&result.plus_terms, &result.minus_terms}) {
+        std::sort(terms->begin(), terms->end());
+        terms->erase(std::unique(terms->begin(), terms->end()), terms->end());
+    }
+    return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-        return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+std::string SearchServer::MakeQueryCacheKey(const Query& query, DocumentStatus status, size_t top_k) {
+    std::string key;
+    key.reserve(2 * sizeof(uint64_t) + (query.plus_terms.size() + query.minus_terms.size()) * sizeof(TermId));
+    const uint64_t header[] = {static_cast<uint64_t>(status) << 32 | query.plus_terms.size(), top_k};
+    key.append(reinterpret_cast<const char*>(header), sizeof(header));
+    key.append(reinterpret_cast<const char*>(query.plus_terms.data()), query.plus_terms.size() * sizeof(TermId));
+    key.append(reinterpret_cast<const char*>(query.minus_terms.data()), query.minus_terms.size() * sizeof(TermId));
+    return key;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+        return idf_cache_.Get(term_id, [this, term_id] {
+            return log(GetDocumentCount() * 1.0 / term_document_counts_[term_id]);
+        });
+}
+
+void SearchServer::ExcludeMinusTerms(const Query& query, const IndexSegment& segment, DocumentOrdinal first,
+                                     DocumentOrdinal last, ScoreAccumulator& accumulator) const {
+    for (const TermId term_id : query.minus_terms) {
+        ForEachPostingInRange(segment.GetPostings(term_id), first, last, [&accumulator](DocumentOrdinal offset, uint32_t) {
+            accumulator.Exclude(offset);
+        });
+    }
+}
+
+void SearchServer::UpdateRetrievalStats(const Query& query, size_t postings_scored) const {
+    size_t postings_total = 0;
+    for (const TermId term_id : query.plus_terms) {
+        postings_total += GetPostingCount(term_id);
+    }
+    postings_scored_.fetch_add(postings_scored, std::memory_order_relaxed);
+    postings_skipped_.fetch_add(postings_total - std::min(postings_total, postings_scored), std::memory_order_relaxed);
+}
+
+bool SearchServer::DocumentHasTerm(const std::vector<DocumentTerm>& document_terms, TermId term_id) {
+        const auto it = std::lower_bound(document_terms.begin(), document_terms.end(), term_id,
+                                         [](const DocumentTerm& term, TermId id) {
+                                             return term.term_id < id;
+                                         });
+        return it != document_terms.end() && it->term_id == term_id;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view& document, DocumentStatus status,
@@ -245,32 +733,663 @@ void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(std::execution::seq, document_id);
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static std::map<std::string_view, double> result;
-    if ( (document_to_word_freqs_.count(document_id) != 0) && (document_to_word_freqs_.at(document_id).size() != 0 ) ) {
-        return document_to_word_freqs_.at(document_id);
-    } else {
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    std::vector<int> removed;
+    removed.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (id_to_ordinal_.count(document_id) > 0) {
+            removed.push_back(document_id);
+        }
+    }
+    std::sort(removed.begin(), removed.end());
+    removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+    if (removed.empty()) {
+        return;
+    }
+    LogRemoveDocuments(removed);
+    InstallMerge(false);
+    bool needs_compaction = false;
+    for (const int document_id : removed) {
+        const DocumentOrdinal ordinal = id_to_ordinal_.at(document_id);
+        IndexSegment& segment = FindSegment(ordinal);
+        segment.MarkDeleted(ordinal);
+        needs_compaction |= segment.IsSealed() && segment.GetTombstoneRatio() > segment_options_.max_tombstone_ratio;
+        ForgetDocument(ordinal);
+    }
+    ++index_version_;
+    idf_cache_.Invalidate();
+    if (needs_compaction) {
+        ScheduleMerge();
+    }
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> result;
+    const auto it = id_to_ordinal_.find(document_id);
+    if (it == id_to_ordinal_.end()) {
         return result;
     }
+    const double inv_word_count = documents_[it->second].inv_word_count;
+    for (const auto [term_id, term_count] : document_terms_[it->second]) {
+        result.emplace(terms_.GetWord(term_id), term_count * inv_word_count);
+    }
+    return result;
+}
+
+uint64_t SearchServer::GetTermSetFingerprint(int document_id) const {
+    // сумма перемешанных id термов не зависит от их порядка;
+    // перемешивание (финализатор splitmix64) разносит близкие id далеко друг от друга
+    uint64_t fingerprint = 0;
+    for (const DocumentTerm& term : document_terms_[id_to_ordinal_.at(document_id)]) {
+        uint64_t x = term.term_id + 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        fingerprint += x ^ (x >> 31);
+    }
+    return fingerprint;
+}
+
+bool SearchServer::HasSameTerms(int lhs_document_id, int rhs_document_id) const {
+    const auto& lhs = document_terms_[id_to_ordinal_.at(lhs_document_id)];
+    const auto& rhs = document_terms_[id_to_ordinal_.at(rhs_document_id)];
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const DocumentTerm& l, const DocumentTerm& r) {
+        return l.term_id == r.term_id;
+    });
+}
+
+void SearchServer::EnableNearDuplicateIndex(const NearDuplicateIndex::Options& options) {
+    auto index = std::make_unique<NearDuplicateIndex>(options);
+    IndexNearDuplicates(*index, 0, static_cast<DocumentOrdinal>(documents_.size()));
+    near_duplicates_ = std::move(index);
+}
+
+void SearchServer::DisableNearDuplicateIndex() {
+    near_duplicates_.reset();
+}
+
+size_t SearchServer::GetRejectedNearDuplicateCount() const {
+    return rejected_near_duplicates_;
+}
+
+std::vector<SearchServer::NearDuplicate> SearchServer::FindNearDuplicates(double threshold) const {
+    std::unique_ptr<NearDuplicateIndex> temporary;
+    const NearDuplicateIndex* index = near_duplicates_.get();
+    if (!index) {
+        temporary = std::make_unique<NearDuplicateIndex>(NearDuplicateIndex::Options{});
+        IndexNearDuplicates(*temporary, 0, static_cast<DocumentOrdinal>(documents_.size()));
+        index = temporary.get();
+    }
+    const std::vector<int> document_ids(document_ids_.begin(), document_ids_.end());
+    std::vector<std::vector<NearDuplicate>> found(document_ids.size());
+    std::vector<size_t> indexes(document_ids.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        const int document_id = document_ids[i];
+        const auto& document_terms = document_terms_[id_to_ordinal_.at(document_id)];
+        for (const int candidate_id : index->GetCandidates(*index->FindSignature(document_id))) {
+            if (candidate_id >= document_id) {
+                break;
+            }
+            const double similarity = ComputeJaccard(document_terms, document_terms_[id_to_ordinal_.at(candidate_id)]);
+            if (similarity >= threshold) {
+                found[i].push_back({document_id, candidate_id, similarity});
+            }
+        }
+    });
+    std::vector<NearDuplicate> result;
+    for (const auto& pairs : found) {
+        result.insert(result.end(), pairs.begin(), pairs.end());
+    }
+    return result;
+}
+
+double SearchServer::ComputeJaccard(const std::vector<DocumentTerm>& lhs, const std::vector<DocumentTerm>& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common = 0;
+    for (auto l = lhs.begin(), r = rhs.begin(); l != lhs.end() && r != rhs.end();) {
+        if (l->term_id < r->term_id) {
+            ++l;
+        } else if (r->term_id < l->term_id) {
+            ++r;
+        } else {
+            ++common;
+            ++l;
+            ++r;
+        }
+    }
+    return static_cast<double>(common) / (lhs.size() + rhs.size() - common);
+}
+
+bool SearchServer::IsNearDuplicate(const std::vector<std::string_view>& words) const {
+    // новым словам достаются те id, которые раздаст им AddDocument:
+    // по порядку первого появления вслед за уже известными
+    std::vector<DocumentTerm> terms;
+    std::unordered_map<std::string_view, TermId> new_terms;
+    for (const std::string_view word : words) {
+        if (const auto term_id = terms_.Find(word)) {
+            terms.push_back({*term_id, 0});
+        } else {
+            const auto [it, inserted] = new_terms.emplace(word, static_cast<TermId>(terms_.size() + new_terms.size()));
+            terms.push_back({it->second, 0});
+        }
+    }
+    std::sort(terms.begin(), terms.end(), [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+    terms.erase(std::unique(terms.begin(), terms.end(), [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+        return lhs.term_id == rhs.term_id;
+    }), terms.end());
+
+    const auto signature = near_duplicates_->ComputeSignature(terms, [](const DocumentTerm& term) {
+        return term.term_id;
+    });
+    const double threshold = near_duplicates_->GetOptions().reject_threshold;
+    const auto candidates = near_duplicates_->GetCandidates(signature);
+    return std::any_of(candidates.begin(), candidates.end(), [&](int candidate_id) {
+        return ComputeJaccard(terms, document_terms_[id_to_ordinal_.at(candidate_id)]) >= threshold;
+    });
+}
+
+void SearchServer::IndexNearDuplicates(NearDuplicateIndex& index, DocumentOrdinal first, DocumentOrdinal last) const {
+    std::vector<DocumentOrdinal> ordinals;
+    for (DocumentOrdinal ordinal = first; ordinal < last; ++ordinal) {
+        const auto it = id_to_ordinal_.find(documents_[ordinal].id);
+        if (it != id_to_ordinal_.end() && it->second == ordinal) {
+            ordinals.push_back(ordinal);
+        }
+    }
+    // подписи независимы и считаются параллельно, а в индекс добавляются по одной
+    std::vector<NearDuplicateIndex::Signature> signatures(ordinals.size());
+    std::transform(std::execution::par, ordinals.begin(), ordinals.end(), signatures.begin(), [&](DocumentOrdinal ordinal) {
+        return index.ComputeSignature(document_terms_[ordinal], [](const DocumentTerm& term) {
+            return term.term_id;
+        });
+    });
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        index.Add(documents_[ordinals[i]].id, std::move(signatures[i]));
+    }
+}
+
+// Разделы снимка поискового сервера в порядке записи
+enum SnapshotSection : size_t {
+    STOP_WORDS,
+    TERM_OFFSETS,
+    TERM_CHARS,
+    SEGMENTS,
+    POSTING_LISTS,
+    POSTING_DATA,
+    POSTING_BLOCKS,
+    DOCUMENTS,
+    DOCUMENT_TERM_OFFSETS,
+    DOCUMENT_TERMS,
+    TEXT_OFFSETS,
+    TEXT_CHARS,
+    LAST_LSN,
+    SNAPSHOT_SECTION_COUNT,
+};
+
+// Списки вхождений сегмента — posting_list_count записей POSTING_LISTS
+// начиная с posting_list_begin, по одной на id терма
+struct SnapshotSegment {
+    uint32_t first_ordinal;
+    uint32_t document_count;
+    uint64_t posting_list_begin;
+    uint64_t posting_list_count;
+    uint32_t sealed;
+    // удалённые документы сегмента, чьих записей в списках уже нет
+    uint32_t purged_count;
+};
+
+struct SnapshotPostingList {
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t block_offset;
+    uint64_t block_count;
+    uint64_t size;
+    double max_weight;
+};
+
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    // 0 — документ удалён, его порядковый номер не переиспользуется
+    uint32_t alive;
+    double inv_word_count;
+};
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    static_assert(std::is_trivially_copyable_v<DocumentTerm> && sizeof(DocumentTerm) == 8);
+    VerifySnapshot();
+    SnapshotWriter writer;
+
+    std::string stop_words;
+    for (const std::string_view word : stop_words_) {
+        if (!stop_words.empty()) {
+            stop_words.push_back(' ');
+        }
+        stop_words += word;
+    }
+    std::vector<uint64_t> term_offsets = {0};
+    std::string term_chars;
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        term_chars += terms_.GetWord(term_id);
+        term_offsets.push_back(term_chars.size());
+    }
+    writer.AddSection();
+    writer.Append(stop_words.data(), stop_words.size());
+    writer.AddSection();
+    writer.AppendArray(term_offsets);
+    writer.AddSection();
+    writer.Append(term_chars.data(), term_chars.size());
+
+    // отметки об удалении не сохраняются: они восстанавливаются по разделу DOCUMENTS
+    std::vector<SnapshotSegment> segments;
+    std::vector<PostingList::RawData> raw_postings;
+    for (const auto& segment : segments_) {
+        segments.push_back({segment->GetFirstOrdinal(), static_cast<uint32_t>(segment->GetDocumentCount()),
+                            raw_postings.size(), segment->GetTermCount(), segment->IsSealed(),
+                            static_cast<uint32_t>(segment->GetPurgedCount())});
+        for (TermId term_id = 0; term_id < segment->GetTermCount(); ++term_id) {
+            raw_postings.push_back(segment->GetPostings(term_id).GetRawData());
+        }
+    }
+    std::vector<SnapshotPostingList> posting_lists;
+    posting_lists.reserve(raw_postings.size());
+    uint64_t data_offset = 0;
+    uint64_t block_offset = 0;
+    for (const auto& raw : raw_postings) {
+        posting_lists.push_back({data_offset, raw.data_size, block_offset, raw.block_count, raw.size, raw.max_weight});
+        data_offset += raw.data_size;
+        block_offset += raw.block_count;
+    }
+    writer.AddSection();
+    writer.AppendArray(segments);
+    writer.AddSection();
+    writer.AppendArray(posting_lists);
+    writer.AddSection();
+    for (const auto& raw : raw_postings) {
+        writer.Append(raw.data, raw.data_size);
+    }
+    writer.AddSection();
+    for (const auto& raw : raw_postings) {
+        writer.Append(raw.blocks, raw.block_count * sizeof(PostingList::Block));
+    }
+
+    std::vector<SnapshotDocument> documents;
+    std::vector<uint64_t> document_term_offsets = {0};
+    std::vector<uint64_t> text_offsets = {0};
+    documents.reserve(documents_.size());
+    for (DocumentOrdinal ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        const DocumentData& data = documents_[ordinal];
+        const auto it = id_to_ordinal_.find(data.id);
+        const bool alive = it != id_to_ordinal_.end() && it->second == ordinal;
+        documents.push_back({data.id, ratings_.Get(ordinal), static_cast<int32_t>(data.status), alive, data.inv_word_count});
+        document_term_offsets.push_back(document_term_offsets.back() + document_terms_[ordinal].size());
+        text_offsets.push_back(text_offsets.back() + (alive ? documents_text_.Get(data.text_id).size() : 0));
+    }
+    writer.AddSection();
+    writer.AppendArray(documents);
+    writer.AddSection();
+    writer.AppendArray(document_term_offsets);
+    writer.AddSection();
+    for (const auto& document_terms : document_terms_) {
+        writer.AppendArray(document_terms);
+    }
+    writer.AddSection();
+    writer.AppendArray(text_offsets);
+    writer.AddSection();
+    for (size_t ordinal = 0; ordinal < documents.size(); ++ordinal) {
+        if (documents[ordinal].alive) {
+            const std::string_view text = documents_text_.Get(documents_[ordinal].text_id);
+            writer.Append(text.data(), text.size());
+        }
+    }
+    writer.AddSection();
+    writer.Append(&last_lsn_, sizeof(last_lsn_));
+
+    writer.Save(path);
 }
 
-void RemoveDuplicates(SearchServer& search_server) {
-    std::set<int> duplicates_id;
-    std::map<std::set<std::string_view>, std::set<int>> work_base;
-        for (const int id : search_server) {
-            std::set<std::string_view> words_;
-            for (const auto& [words_from_doc, d] : search_server.GetWordFrequencies(id)) {
-                words_.insert(words_from_doc);
+std::unique_ptr<SearchServer> SearchServer::LoadSnapshot(const std::string& path) {
+    const auto snapshot = std::make_shared<const SnapshotReader>(path);
+    const SnapshotReader& reader = *snapshot;
+    if (reader.GetSectionCount() != SNAPSHOT_SECTION_COUNT) {
+        throw std::runtime_error(path + " has unexpected number of sections");
+    }
+    auto corrupted = [&path](const std::string& what) {
+        return std::runtime_error(path + " is corrupted: " + what);
+    };
+    // проверяет, что смещения соседних записей не убывают и не выходят за раздел
+    auto check_offsets = [&corrupted](const uint64_t* offsets, size_t count, size_t limit, const std::string& what) {
+        if (count == 0 || offsets[0] != 0 || offsets[count - 1] != limit
+            || !std::is_sorted(offsets, offsets + count)) {
+            throw corrupted(what);
+        }
+    };
+
+    auto server = std::make_unique<SearchServer>(std::string(reader.GetSection(STOP_WORDS)));
+
+    size_t term_offset_count = 0;
+    const auto* term_offsets = reader.GetArray<uint64_t>(TERM_OFFSETS, term_offset_count);
+    const std::string_view term_chars = reader.GetSection(TERM_CHARS);
+    check_offsets(term_offsets, term_offset_count, term_chars.size(), "term dictionary");
+    for (size_t i = 0; i + 1 < term_offset_count; ++i) {
+        const auto word = term_chars.substr(term_offsets[i], term_offsets[i + 1] - term_offsets[i]);
+        if (server->terms_.InternExternal(word) != i) {
+            throw corrupted("duplicate term");
+        }
+    }
+
+    size_t document_count = 0;
+    const auto* documents = reader.GetArray<SnapshotDocument>(DOCUMENTS, document_count);
+
+    size_t segment_count = 0;
+    const auto* segments = reader.GetArray<SnapshotSegment>(SEGMENTS, segment_count);
+    size_t posting_list_count = 0;
+    const auto* posting_lists = reader.GetArray<SnapshotPostingList>(POSTING_LISTS, posting_list_count);
+    // списки вхождений читаются из отображения; сегмент проверяет их перед первым чтением
+    const std::string_view posting_data = reader.GetUnverifiedSection(POSTING_DATA);
+    size_t block_count = 0;
+    const auto* blocks = reader.GetUnverifiedArray<PostingList::Block>(POSTING_BLOCKS, block_count);
+    uint64_t next_ordinal = 0;
+    for (size_t i = 0; i < segment_count; ++i) {
+        const SnapshotSegment& segment = segments[i];
+        if (segment.first_ordinal != next_ordinal || segment.document_count > document_count - next_ordinal
+            || segment.posting_list_count > server->terms_.size()
+            || segment.posting_list_begin > posting_list_count
+            || segment.posting_list_count > posting_list_count - segment.posting_list_begin
+            || (!segment.sealed && i + 1 != segment_count) || segment.purged_count > segment.document_count) {
+            throw corrupted("segment bounds");
+        }
+        next_ordinal += segment.document_count;
+        std::vector<double> inv_word_counts;
+        inv_word_counts.reserve(segment.document_count);
+        for (uint64_t ordinal = segment.first_ordinal; ordinal < next_ordinal; ++ordinal) {
+            inv_word_counts.push_back(documents[ordinal].inv_word_count);
+        }
+        std::vector<PostingList> term_postings;
+        term_postings.reserve(segment.posting_list_count);
+        for (size_t j = segment.posting_list_begin; j < segment.posting_list_begin + segment.posting_list_count; ++j) {
+            const SnapshotPostingList& list = posting_lists[j];
+            if (list.data_offset > posting_data.size() || list.data_size > posting_data.size() - list.data_offset
+                || list.block_offset > block_count || list.block_count > block_count - list.block_offset) {
+                throw corrupted("posting list bounds");
             }
-            const int last_item = *(work_base[words_].end());
-            work_base[words_].insert(id);
-            if (work_base.at(words_).size() > 1) {
-                duplicates_id.insert(std::max(id, last_item));
+            term_postings.push_back(PostingList::FromRawData({
+                reinterpret_cast<const uint8_t*>(posting_data.data()) + list.data_offset, list.data_size,
+                blocks + list.block_offset, list.block_count,
+                list.size, list.max_weight}));
+        }
+        server->segments_.push_back(std::make_shared<IndexSegment>(
+            segment.first_ordinal, std::move(inv_word_counts), std::move(term_postings), segment.sealed != 0,
+            segment.purged_count, [snapshot] {
+                snapshot->VerifySection(POSTING_DATA);
+                snapshot->VerifySection(POSTING_BLOCKS);
+            }));
+    }
+    if (next_ordinal != document_count) {
+        throw corrupted("segment bounds");
+    }
+
+    size_t document_term_offset_count = 0;
+    const auto* document_term_offsets = reader.GetArray<uint64_t>(DOCUMENT_TERM_OFFSETS, document_term_offset_count);
+    size_t document_term_count = 0;
+    const auto* document_terms = reader.GetArray<DocumentTerm>(DOCUMENT_TERMS, document_term_count);
+    size_t text_offset_count = 0;
+    const auto* text_offsets = reader.GetArray<uint64_t>(TEXT_OFFSETS, text_offset_count);
+    const std::string_view text_chars = reader.GetUnverifiedSection(TEXT_CHARS);
+    const uint32_t text_block = server->documents_text_.AttachExternal(text_chars);
+    if (document_term_offset_count != document_count + 1 || text_offset_count != document_count + 1) {
+        throw corrupted("document count");
+    }
+    check_offsets(document_term_offsets, document_term_offset_count, document_term_count, "forward index");
+    check_offsets(text_offsets, text_offset_count, text_chars.size(), "document texts");
+
+    server->documents_.reserve(document_count);
+    server->document_terms_.resize(document_count);
+    server->term_document_counts_.resize(server->terms_.size());
+    for (DocumentOrdinal ordinal = 0; ordinal < document_count; ++ordinal) {
+        const SnapshotDocument& document = documents[ordinal];
+        server->document_terms_[ordinal].assign(document_terms + document_term_offsets[ordinal],
+                                                document_terms + document_term_offsets[ordinal + 1]);
+        for (const DocumentTerm& term : server->document_terms_[ordinal]) {
+            if (term.term_id >= server->terms_.size()) {
+                throw corrupted("forward index term id");
             }
+            server->term_document_counts_[term.term_id] += document.alive != 0;
         }
-           
-        for (const int id : duplicates_id) {
-            std::cout << "Found duplicate document id " << id << std::endl;
-            search_server.RemoveDocument(id);
+        TextArena::TextId text_id = 0;
+        if (document.alive) {
+            text_id = server->documents_text_.AddExternal(text_block, text_offsets[ordinal],
+                                                          text_offsets[ordinal + 1] - text_offsets[ordinal]);
+            if (document.id < 0 || !server->id_to_ordinal_.emplace(document.id, ordinal).second) {
+                throw corrupted("document id");
+            }
+            server->document_ids_.insert(document.id);
+            if (document.status < 0 || static_cast<size_t>(document.status) >= STATUS_COUNT) {
+                throw corrupted("document status");
+            }
+            server->SetStatusBit(ordinal, static_cast<DocumentStatus>(document.status), true);
+        } else {
+            server->FindSegment(ordinal).MarkDeleted(ordinal);
         }
-}
\ No newline at end of file
+        server->documents_.push_back({document.id, static_cast<DocumentStatus>(document.status), document.inv_word_count, text_id});
+        server->ratings_.Append(document.rating);
+    }
+    for (const auto& segment : server->segments_) {
+        if (segment->GetPurgedCount() > segment->GetDocumentCount() - segment->GetLiveDocumentCount()) {
+            throw corrupted("segment purged count");
+        }
+    }
+    // хвост из удалённых документов тоже должен быть покрыт картами статусов
+    for (auto& status_bits : server->status_documents_) {
+        status_bits.resize((document_count + 63) / 64, 0);
+    }
+
+    size_t last_lsn_count = 0;
+    const auto* last_lsn = reader.GetArray<uint64_t>(LAST_LSN, last_lsn_count);
+    if (last_lsn_count != 1) {
+        throw corrupted("last LSN");
+    }
+    server->last_lsn_ = *last_lsn;
+
+    server->idf_cache_.Resize(server->terms_.size());
+    server->snapshot_ = snapshot;
+    return server;
+}
+
+void SearchServer::VerifySnapshot() const {
+    if (snapshot_) {
+        snapshot_->VerifyAll();
+    }
+}
+
+// Типы записей журнала упреждающей записи
+enum WalRecordType : uint32_t {
+    WAL_ADD_DOCUMENT = 1,
+    WAL_REMOVE_DOCUMENT = 2,
+    WAL_REMOVE_DOCUMENTS = 3,
+};
+
+template <typename T>
+void AppendPod(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T ReadPod(std::string_view& in) {
+    T value;
+    if (in.size() < sizeof(value)) {
+        throw std::runtime_error("Truncated write-ahead log record");
+    }
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return value;
+}
+
+void SearchServer::LogAddDocument(int document_id, std::string_view document, DocumentStatus status,
+                                  const std::vector<int>& ratings) {
+    if (!wal_ && !wal_record_sink_) {
+        return;
+    }
+    // id, статус, число оценок, оценки, затем текст до конца записи
+    std::string payload;
+    payload.reserve(3 * sizeof(int32_t) + ratings.size() * sizeof(int32_t) + document.size());
+    AppendPod<int32_t>(payload, document_id);
+    AppendPod<int32_t>(payload, static_cast<int32_t>(status));
+    AppendPod<uint32_t>(payload, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        AppendPod<int32_t>(payload, rating);
+    }
+    payload += document;
+    WriteWalRecord(WAL_ADD_DOCUMENT, std::move(payload));
+}
+
+void SearchServer::LogRemoveDocument(int document_id) {
+    if (!wal_ && !wal_record_sink_) {
+        return;
+    }
+    std::string payload;
+    AppendPod<int32_t>(payload, document_id);
+    WriteWalRecord(WAL_REMOVE_DOCUMENT, std::move(payload));
+}
+
+void SearchServer::LogRemoveDocuments(const std::vector<int>& document_ids) {
+    if (!wal_ && !wal_record_sink_) {
+        return;
+    }
+    // число id, затем сами id
+    std::string payload;
+    payload.reserve(sizeof(uint32_t) + document_ids.size() * sizeof(int32_t));
+    AppendPod<uint32_t>(payload, static_cast<uint32_t>(document_ids.size()));
+    for (const int document_id : document_ids) {
+        AppendPod<int32_t>(payload, document_id);
+    }
+    WriteWalRecord(WAL_REMOVE_DOCUMENTS, std::move(payload));
+}
+
+void SearchServer::WriteWalRecord(uint32_t type, std::string payload) {
+    if (wal_record_sink_) {
+        wal_record_sink_->push_back({type, std::move(payload)});
+    } else {
+        last_lsn_ = wal_->Append(type, payload);
+    }
+}
+
+void SearchServer::ApplyWalRecord(uint32_t type, std::string_view payload) {
+    if (type == WAL_REMOVE_DOCUMENTS) {
+        std::vector<int> document_ids(ReadPod<uint32_t>(payload));
+        for (int& document_id : document_ids) {
+            document_id = ReadPod<int32_t>(payload);
+        }
+        RemoveDocuments(document_ids);
+        return;
+    }
+    const int document_id = ReadPod<int32_t>(payload);
+    if (type == WAL_REMOVE_DOCUMENT) {
+        RemoveDocument(document_id);
+        return;
+    }
+    if (type != WAL_ADD_DOCUMENT) {
+        throw std::runtime_error("Unknown write-ahead log record type " + std::to_string(type));
+    }
+    const auto status = static_cast<DocumentStatus>(ReadPod<int32_t>(payload));
+    std::vector<int> ratings(ReadPod<uint32_t>(payload));
+    for (int& rating : ratings) {
+        rating = ReadPod<int32_t>(payload);
+    }
+    AddDocument(document_id, payload, status, ratings);
+}
+
+std::unique_ptr<SearchServer> SearchServer::Recover(const std::string& stop_words_text, const std::string& checkpoint_path,
+                                                    const std::string& wal_path, WriteAheadLog::Options options) {
+    auto server = std::filesystem::exists(checkpoint_path) ? LoadSnapshot(checkpoint_path)
+                                                           : std::make_unique<SearchServer>(stop_words_text);
+    const uint64_t checkpoint_lsn = server->last_lsn_;
+    const uint64_t last_lsn = WriteAheadLog::Replay(wal_path, [&server, checkpoint_lsn](uint64_t lsn, uint32_t type,
+                                                                                      std::string_view payload) {
+        // записи до контрольной точки остаются, если сбой случился между её записью и очисткой журнала
+        if (lsn > checkpoint_lsn) {
+            server->ApplyWalRecord(type, payload);
+            server->last_lsn_ = lsn;
+        }
+    });
+    server->wal_ = std::make_unique<WriteAheadLog>(wal_path, std::max(last_lsn, checkpoint_lsn) + 1, options);
+    return server;
+}
+
+void SearchServer::Checkpoint(const std::string& checkpoint_path) {
+    SyncWal();
+    SaveCheckpoint(checkpoint_path);
+    if (wal_) {
+        wal_->Reset();
+    }
+}
+
+void SearchServer::SaveCheckpoint(const std::string& checkpoint_path) const {
+    const std::string temporary_path = checkpoint_path + ".tmp"s;
+    SaveSnapshot(temporary_path);
+    std::filesystem::rename(temporary_path, checkpoint_path);
+    // журнал можно очищать, только когда переименование дошло до диска
+    SyncParentDirectory(checkpoint_path);
+}
+
+void SearchServer::SyncWal() {
+    if (wal_) {
+        wal_->Sync();
+    }
+}
+
+std::unique_ptr<WriteAheadLog> SearchServer::ReleaseWal() {
+    return std::move(wal_);
+}
+
+void SearchServer::SetWalRecordSink(std::vector<WalRecord>* records) {
+    wal_record_sink_ = records;
+}
+
+void SearchServer::SetLastLsn(uint64_t lsn) {
+    last_lsn_ = lsn;
+}
+
+std::unique_ptr<SearchServer> SearchServer::Clone() const {
+    // копия переносит тексты документов, поэтому они не должны быть повреждены
+    VerifySnapshot();
+    // сервер мог быть создан из контейнера стоп-слов, тогда raw_stop_words_ пуст
+    std::string stop_words;
+    for (const std::string_view word : stop_words_) {
+        stop_words += word;
+        stop_words.push_back(' ');
+    }
+    auto clone = std::make_unique<SearchServer>(stop_words);
+    clone->segment_options_ = segment_options_;
+    clone->retrieval_mode_ = retrieval_mode_;
+    clone->thread_pool_ = thread_pool_;
+    if (query_cache_) {
+        clone->EnableQueryCache(query_cache_->GetOptions());
+    }
+    // те же id термов дают тот же порядок сложения вкладов, а значит ту же релевантность до бита
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        clone->terms_.Intern(terms_.GetWord(term_id));
+    }
+    // удалённые документы не переносятся, поэтому порядковые номера в копии свои
+    std::vector<NewDocument> documents;
+    documents.reserve(document_ids_.size());
+    for (DocumentOrdinal ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        const DocumentData& data = documents_[ordinal];
+        const auto it = id_to_ordinal_.find(data.id);
+        if (it != id_to_ordinal_.end() && it->second == ordinal) {
+            documents.push_back({data.id, documents_text_.Get(data.text_id), data.status, {ratings_.Get(ordinal)}});
+        }
+    }
+    clone->AddDocuments(documents);
+    clone->last_lsn_ = last_lsn_;
+    // после добавления, чтобы копия не отбраковала ни одного документа оригинала
+    if (near_duplicates_) {
+        clone->EnableNearDuplicateIndex(near_duplicates_->GetOptions());
+    }
+    return clone;
+}
@@ -1,22 +1,53 @@
 #pragma once
 #include "string_processing.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "idf_cache.h"
+#include "index_segment.h"
+#include "near_duplicate_index.h"
+#include "numeric_column.h"
+#include "posting_list.h"
+#include "query_cache.h"
+#include "score_accumulator.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+#include "text_arena.h"
+#include "thread_pool.h"
+#include "write_ahead_log.h"
+#include "top_documents.h"
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <numeric>
+#include <exception>
 #include <execution>
+#include <functional>
+#include <future>
+#include <optional>
 #include <string_view>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double ACCURACY = 1e-6;
-const int LOCKS = 3'000;
+
+// Способ отбора лучших документов.
+// EXHAUSTIVE считает релевантность всех документов, содержащих плюс-слова.
+// BLOCK_MAX_WAND пропускает документы и целые блоки списков вхождений, чья верхняя
+// оценка релевантности не позволяет попасть в top_k; выдача при этом та же.
+enum class RetrievalMode {
+    EXHAUSTIVE,
+    BLOCK_MAX_WAND,
+};
 
 class SearchServer {
 public:
@@ -30,24 +61,169 @@ SearchServer(const StringContainer& stop_words);
     ~SearchServer() = default;
 
     void AddDocument(int document_id, const std::string_view& document, DocumentStatus status, const std::vector<int>& ratings);
+
+    struct NewDocument {
+        int id = 0;
+        std::string_view text;
+        DocumentStatus status = DocumentStatus::ACTUAL;
+        std::vector<int> ratings;
+    };
+
+    // Добавляет пакет документов с тем же результатом, что и AddDocument для каждого по порядку.
+    // Тексты разбираются параллельно, частичные списки вхождений строятся по частям пакета
+    // и сливаются в индекс за один проход по термам. Если хотя бы один документ
+    // некорректен, исключение выбрасывается до изменения индекса.
+    void AddDocuments(const std::vector<NewDocument>& documents);
     
+    // Фильтр выдачи из условий на метаданные документа. В отличие от предиката
+    // он вычисляется в карту подходящих документов один раз на запрос
+    // по индексам статусов и рейтингов, и оценка не читает данных документов.
+    struct DocumentFilter {
+        // пусто — любой статус
+        std::optional<DocumentStatus> status;
+        int min_rating = std::numeric_limits<int>::min();
+        int max_rating = std::numeric_limits<int>::max();
+    };
+
+    // top_k — сколько лучших документов вернуть
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, const DocumentFilter& filter,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query) const;
     
     template <typename DocumentPredicate, class ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <class ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentFilter& filter,
+                                           size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <class ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query) const;
 
+    // Асинхронный поиск на исполнителе сервера (см. GetExecutor). Возвращает сразу;
+    // ошибка разбора запроса приходит исключением из future::get.
+    // Сервер должен жить и не меняться, пока запрос не выполнен.
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Вызывается на потоке исполнителя с выдачей или, при ошибке, с пустой выдачей и исключением.
+    // Не должен бросать исключения.
+    using SearchCallback = std::function<void(std::vector<Document> documents, std::exception_ptr error)>;
+
+    void FindTopDocumentsAsync(std::string raw_query, DocumentStatus status, size_t top_k, SearchCallback callback) const;
+
     int GetDocumentCount() const;
+
+    void SetRetrievalMode(RetrievalMode mode);
+
+    RetrievalMode GetRetrievalMode() const;
+
+    // Сколько записей списков вхождений плюс-слов было оценено и сколько пропущено
+    // отсечением с момента последнего сброса
+    struct RetrievalStats {
+        uint64_t postings_scored = 0;
+        uint64_t postings_skipped = 0;
+    };
+
+    RetrievalStats GetRetrievalStats() const;
+
+    void ResetRetrievalStats();
+
+    // Параметры сегментов индекса. Новые документы дописываются в открытый сегмент;
+    // набрав seal_document_count документов, он запечатывается и больше не меняется.
+    // Когда набирается merge_factor соседних запечатанных сегментов одного яруса
+    // (ярус растёт в merge_factor раз с каждым слиянием), они сливаются в один,
+    // а записи удалённых документов при этом выбрасываются.
+    struct SegmentOptions {
+        size_t seal_document_count = 4'096;
+        size_t merge_factor = 4;
+        // сливать в фоновом потоке; результат подменяет входные сегменты
+        // при следующем изменении индекса или в WaitForMerges
+        bool background_merge = true;
+        // запечатанный сегмент, в котором доля записей удалённых документов больше этой,
+        // переписывается без них, не дожидаясь слияния с соседями
+        double max_tombstone_ratio = 0.3;
+    };
+
+    void SetSegmentOptions(const SegmentOptions& options);
+
+    size_t GetSegmentCount() const;
+
+    // Дожидается фоновых слияний и подставляет их результаты в индекс
+    void WaitForMerges();
+
+    // Удалённые документы, записи которых ещё лежат в списках вхождений,
+    // и сколько раз сегменты сливались и переписывались
+    struct DeletionStats {
+        size_t live_documents = 0;
+        size_t tombstones = 0;
+        uint64_t merges = 0;
+        uint64_t compactions = 0;
+
+        double GetTombstoneRatio() const {
+            return live_documents + tombstones == 0 ? 0.0 : static_cast<double>(tombstones) / (live_documents + tombstones);
+        }
+    };
+
+    DeletionStats GetDeletionStats() const;
+
+    // Пул, на котором выполняются параллельные версии FindTopDocuments и ProcessQueries
+    // вместо std::execution::par. Пул может быть общим у нескольких серверов; nullptr — без пула.
+    void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+
+    ThreadPool* GetThreadPool() const;
+
+    // Пул для асинхронных запросов: заданный SetThreadPool или общий ThreadPool::GetDefault()
+    ThreadPool& GetExecutor() const;
+
+    // Кэш выдачи FindTopDocuments с фильтром по статусу. Ключ — разобранный запрос
+    // (термы плюс- и минус-слов, упорядоченные и без повторов), статус и top_k.
+    // Любое изменение индекса увеличивает его версию, и записи прежних версий
+    // перестают находиться. Запросы с произвольным предикатом идут мимо кэша.
+    void EnableQueryCache(const QueryCache::Options& options);
+
+    void DisableQueryCache();
+
+    // Индекс почти-дубликатов (см. NearDuplicateIndex) по документам сервера; дальше
+    // он поддерживается при добавлении и удалении документов. С reject_on_insert
+    // AddDocument и AddDocuments молча пропускают почти-дубликаты уже добавленных документов.
+    void EnableNearDuplicateIndex(const NearDuplicateIndex::Options& options);
+
+    void DisableNearDuplicateIndex();
+
+    // Сколько документов было пропущено как почти-дубликаты
+    size_t GetRejectedNearDuplicateCount() const;
+
+    struct NearDuplicate {
+        int document_id = 0;
+        // документ с меньшим id
+        int original_id = 0;
+        // мера Жаккара множеств слов
+        double similarity = 0.0;
+    };
+
+    // Пары документов, у которых мера Жаккара множеств слов не меньше threshold,
+    // по возрастанию (document_id, original_id). Кандидаты ищутся через LSH включённого
+    // индекса или временного с параметрами по умолчанию, поэтому пары со сходством
+    // около порога изредка теряются; сходство найденных пар точное.
+    std::vector<NearDuplicate> FindNearDuplicates(double threshold) const;
+
+    // Статистика кэша; без кэша — нулевая
+    QueryCache::Stats GetQueryCacheStats() const;
     
 auto begin() const{
     return document_ids_.begin();
@@ -58,36 +234,25 @@ auto end() const {
 }
 
 template <class ExecutionPolicy>
-void RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    if (std::find(policy,
-                 std::begin(document_ids_),
-                 std::end(document_ids_),
-                 document_id) == document_ids_.end()) {
+void RemoveDocument(ExecutionPolicy&&, int document_id) {
+    const auto ordinal_it = id_to_ordinal_.find(document_id);
+    if (ordinal_it == id_to_ordinal_.end()) {
         return;
     }
-    
-    const auto& id_words = document_to_word_freqs_.at(document_id);
-    std::vector<std::string> words_(id_words.size());
-    std::transform(policy,
-                   std::begin(id_words),
-                   std::end(id_words),
-                   std::begin(words_),
-                   [](const auto& pair) {
-                       return pair.first;
-                   });
-    
-    std::for_each(policy, 
-                  std::begin(words_),
-                  std::end(words_),
-                  [this, document_id](const auto& word){
-                     word_to_document_freqs_[word].erase(document_id);
-                  });
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    document_to_word_freqs_.erase(document_id);
+    LogRemoveDocument(document_id);
+    const DocumentOrdinal ordinal = ordinal_it->second;
+    // вычитание из счётчиков термов слишком дёшево для параллельного обхода, поэтому policy не используется
+    MarkDocumentDeleted(ordinal);
+    ForgetDocument(ordinal);
+    idf_cache_.Invalidate();
 }
     
 void RemoveDocument(int document_id);
+
+// Удаляет документы с тем же результатом, что и RemoveDocument для каждого, но одним
+// изменением: одна запись журнала, одна смена версии индекса и кэша IDF и одна
+// проверка сегментов на переписывание. Несуществующие id пропускаются.
+void RemoveDocuments(const std::vector<int>& document_ids);
     
 std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query, int document_id) const;    
     
@@ -95,21 +260,181 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::exe
     
 std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, const std::string_view& raw_query, int document_id) const;
     
-const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+// 64-битный отпечаток множества слов документа: не зависит от порядка и числа
+// повторов слов. У документов с одинаковыми множествами слов отпечатки равны,
+// у разных почти всегда различаются. Несуществующий id даёт out_of_range.
+uint64_t GetTermSetFingerprint(int document_id) const;
+
+// Совпадают ли множества слов двух документов
+bool HasSameTerms(int lhs_document_id, int rhs_document_id) const;
+
+// Сохраняет индекс целиком (стоп-слова, словарь, списки вхождений, прямой индекс,
+// метаданные и тексты документов) в двоичный снимок. Данные, ещё читаемые
+// из снимка, из которого загружен сервер, сначала проходят VerifySnapshot,
+// чтобы повреждение не переписалось в новый снимок под новой контрольной суммой.
+void SaveSnapshot(const std::string& path) const;
+
+// Загружает сервер из снимка. Файл отображается в память; списки вхождений,
+// строки термов и тексты документов читаются прямо из отображённых страниц
+// без копирования, а прямой индекс и метаданные документов копируются.
+// Разделы, которые загрузка разбирает, проверяются по контрольным суммам сразу,
+// списки вхождений — перед первым чтением записей, тексты — в VerifySnapshot,
+// так что время загрузки от объёма списков и текстов не зависит.
+// Отображение живёт, пока жив сервер.
+// При ошибке чтения или повреждённом снимке выбрасывает std::runtime_error;
+// повреждённые списки вхождений дают её же из первого запроса или изменения.
+static std::unique_ptr<SearchServer> LoadSnapshot(const std::string& path);
+
+// Проверяет контрольные суммы разделов снимка, не проверенных при загрузке.
+// Для сервера, загруженного не из снимка, ничего не делает.
+// При повреждении выбрасывает std::runtime_error.
+void VerifySnapshot() const;
+
+// Восстанавливает сервер после перезапуска: загружает контрольную точку checkpoint_path,
+// если она есть (иначе начинает с пустого индекса со стоп-словами stop_words_text),
+// проигрывает не вошедший в неё хвост журнала wal_path и дальше записывает
+// в этот журнал каждое AddDocument и RemoveDocument до их применения
+static std::unique_ptr<SearchServer> Recover(const std::string& stop_words_text, const std::string& checkpoint_path,
+                                             const std::string& wal_path, WriteAheadLog::Options options = {});
+
+// Атомарно заменяет контрольную точку снимком текущего индекса и очищает журнал
+void Checkpoint(const std::string& checkpoint_path);
+
+// Атомарно заменяет контрольную точку снимком текущего индекса, не трогая журнал.
+// Когда вернётся, записи журнала до LSN снимка больше не нужны для восстановления.
+void SaveCheckpoint(const std::string& checkpoint_path) const;
+
+// Сбрасывает на диск изменения, накопленные журналом в группе
+void SyncWal();
+
+// Независимая копия индекса с теми же документами, id термов и настройками.
+// Журнал не копируется: изменения копии никуда не записываются.
+std::unique_ptr<SearchServer> Clone() const;
+
+// Запись журнала об одном изменении
+struct WalRecord {
+    uint32_t type = 0;
+    std::string payload;
+};
+
+// Забирает журнал; дальше сервер сам в него не пишет
+std::unique_ptr<WriteAheadLog> ReleaseWal();
+
+// Пока records не nullptr, записи о каждом изменении дописываются туда вместо
+// собственного журнала, чтобы их записал владелец журнала
+void SetWalRecordSink(std::vector<WalRecord>* records);
+
+// Отмечает, что изменения сервера записаны в журнал до LSN lsn включительно
+void SetLastLsn(uint64_t lsn);
     
 private:
+    // Документы нумеруются подряд в порядке добавления; этот порядковый
+    // номер индексирует все внутренние массивы и хранится в списках вхождений.
+    // Номера удалённых документов повторно не используются.
+    using DocumentOrdinal = uint32_t;
+
     struct DocumentData {
-        int rating = 0;
+        int id = 0;
         DocumentStatus status;
+        double inv_word_count = 0.0;
+        TextArena::TextId text_id = 0;
     };
     const std::string raw_stop_words_;
-    std::set<std::string> raw_documents_text_;
+    TextArena documents_text_;
     
     const std::set<std::string_view> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    using TermId = TermDictionary::TermId;
+
+    struct DocumentTerm {
+        TermId term_id;
+        uint32_t term_count;
+    };
+
+    TermDictionary terms_;
+    // IDF термов, индекс — id терма
+    IdfCache idf_cache_;
+    // сегменты индекса по возрастанию номеров документов; вместе покрывают
+    // [0, documents_.size()), последний может быть открыт для добавления
+    // снимок, из отображения которого читают списки вхождений, строки термов и тексты;
+    // объявлен до сегментов и слияния, чтобы отображение закрывалось после них
+    std::shared_ptr<const SnapshotReader> snapshot_;
+    std::vector<std::shared_ptr<IndexSegment>> segments_;
+    SegmentOptions segment_options_;
+    // слияние, идущее в фоне: входные сегменты — segments_[first_segment, first_segment + inputs.size())
+    struct PendingMerge {
+        size_t first_segment = 0;
+        std::vector<std::shared_ptr<const IndexSegment>> inputs;
+        std::future<std::shared_ptr<IndexSegment>> result;
+    };
+    std::optional<PendingMerge> pending_merge_;
+    uint64_t merge_count_ = 0;
+    uint64_t compaction_count_ = 0;
+    // число неудалённых документов с термом, индекс — id терма
+    std::vector<uint32_t> term_document_counts_;
+    // термы документа, упорядоченные по id терма; индекс — порядковый номер
+    std::vector<std::vector<DocumentTerm>> document_terms_;
+    std::vector<DocumentData> documents_;
+    // средние рейтинги документов по порядковым номерам
+    NumericColumn ratings_;
+    std::unordered_map<int, DocumentOrdinal> id_to_ordinal_;
     std::set<int> document_ids_;
+    static constexpr size_t STATUS_COUNT = 4;
+    // неудалённые документы каждого статуса, бит — порядковый номер документа
+    std::array<std::vector<uint64_t>, STATUS_COUNT> status_documents_;
+
+    std::unique_ptr<WriteAheadLog> wal_;
+    std::vector<WalRecord>* wal_record_sink_ = nullptr;
+    // LSN последнего изменения, записанного в журнал; сохраняется в снимке
+    uint64_t last_lsn_ = 0;
+
+    // увеличивается при каждом изменении набора документов
+    uint64_t index_version_ = 0;
+    std::unique_ptr<QueryCache> query_cache_;
+    std::unique_ptr<NearDuplicateIndex> near_duplicates_;
+    size_t rejected_near_duplicates_ = 0;
+
+    RetrievalMode retrieval_mode_ = RetrievalMode::EXHAUSTIVE;
+    std::shared_ptr<ThreadPool> thread_pool_;
+    mutable std::atomic<uint64_t> postings_scored_ = 0;
+    mutable std::atomic<uint64_t> postings_skipped_ = 0;
+
+    void LogAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void LogRemoveDocument(int document_id);
+
+    void LogRemoveDocuments(const std::vector<int>& document_ids);
+
+    // Пишет запись в журнал или в приёмник записей, если он задан
+    void WriteWalRecord(uint32_t type, std::string payload);
+
+    void ApplyWalRecord(uint32_t type, std::string_view payload);
+
+    // Открытый сегмент, в который дописываются новые документы
+    IndexSegment& GetOpenSegment();
+
+    // Запечатывает открытый сегмент, если он набрал seal_document_count документов
+    void SealOpenSegmentIfFull();
+
+    // Выбирает соседние сегменты одного яруса и сливает их (в фоне или сразу)
+    void ScheduleMerge();
+
+    // Подставляет результат фонового слияния; если wait == false и слияние
+    // ещё идёт, ничего не делает
+    void InstallMerge(bool wait);
+
+    IndexSegment& FindSegment(DocumentOrdinal ordinal);
+
+    void MarkDocumentDeleted(DocumentOrdinal ordinal);
+
+    // Убирает удалённый документ из всех структур, кроме сегментов: записи документа
+    // остаются в списках сегмента до его слияния или перезаписи, а из числа документов
+    // с термом он вычитается сразу, чтобы IDF не зависел от того, когда сегмент будет переписан
+    void ForgetDocument(DocumentOrdinal ordinal);
+
+    // Число записей терма во всех сегментах, включая записи удалённых документов
+    size_t GetPostingCount(TermId term_id) const;
 
     bool IsStopWord(const std::string_view& word) const;
 
@@ -122,61 +447,186 @@ private:
     struct QueryWord {
         std::string_view data;
         bool is_minus;
-        bool is_stop;
     };
 
     QueryWord ParseQueryWord(const std::string_view& text) const;
 
+    // Слова запроса, уже переведённые в id термов.
+    // Слова, которых нет в словаре (в том числе стоп-слова), отброшены.
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
     };
 
-    Query ParseQuery(const std::string_view& text) const;
-    
-    Query ParseQuery(std::execution::sequenced_policy, const std::string_view& text) const;
-    
-    Query ParseQuery(std::execution::parallel_policy, const std::string_view& text) const;
+    // Буферы разбора запроса; между запросами сохраняют ёмкость
+    struct QueryBuffers {
+        std::vector<std::string_view> words;
+        Query query;
+        // карта документов, прошедших DocumentFilter, и карта его диапазона рейтингов
+        std::vector<uint64_t> filter_bits;
+        std::vector<uint64_t> rating_bits;
+    };
+
+    // Буферы разбора текущего потока на время одного запроса, как ScoreAccumulator::Lease:
+    // после первых запросов разбор не выделяет памяти. Если буферы уже заняты
+    // (вложенный запрос на том же потоке), выдаются временные.
+    class QueryLease {
+    public:
+        QueryLease();
+        ~QueryLease();
+
+        QueryLease(const QueryLease&) = delete;
+        QueryLease& operator=(const QueryLease&) = delete;
+
+        QueryBuffers& operator*() const {
+            return *buffers_;
+        }
+
+    private:
+        struct ThreadBuffers {
+            QueryBuffers buffers;
+            bool busy = false;
+        };
+
+        QueryBuffers* buffers_;
+        std::unique_ptr<QueryBuffers> temporary_;
+
+        static ThreadBuffers& GetThreadBuffers();
+    };
+
+    // Разбирает запрос в буферы lease; плюс- и минус-термы отсортированы и не повторяются
+    const Query& ParseQuery(const std::string_view& text, QueryLease& lease) const;
+
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+
+    static std::string MakeQueryCacheKey(const Query& query, DocumentStatus status, size_t top_k);
+
+    static bool DocumentHasTerm(const std::vector<DocumentTerm>& document_terms, TermId term_id);
+
+    // Фильтр, который FindTopDocuments со статусом или с DocumentFilter передаёт вместо предиката:
+    // карта принятых неудалённых документов, бит — порядковый номер. Карта покрывает
+    // все номера; оценка проверяет бит, не читая данных документа.
+    struct BitmapFilter {
+        const std::vector<uint64_t>* bits;
+
+        bool Accepts(DocumentOrdinal ordinal) const {
+            return ((*bits)[ordinal / 64] >> (ordinal % 64)) & 1;
+        }
+    };
+
+    template <typename DocumentPredicate>
+    static constexpr bool IS_BITMAP_FILTER = std::is_same_v<std::remove_const_t<DocumentPredicate>, BitmapFilter>;
+
+    // Отмечает документ в карте его статуса или снимает отметку
+    void SetStatusBit(DocumentOrdinal ordinal, DocumentStatus status, bool value);
+
+    // Карта неудалённых документов статуса
+    const std::vector<uint64_t>& GetStatusDocuments(DocumentStatus status) const;
+
+    // Вычисляет карту документов, проходящих фильтр, в buffers.filter_bits
+    void CompileFilter(const DocumentFilter& filter, QueryBuffers& buffers) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view& word) const;
+    // Есть ли в карте отмеченные номера из [first, last)
+    static bool HasBitsInRange(const std::vector<uint64_t>& bits, DocumentOrdinal first, DocumentOrdinal last);
+
+    // Неудалённый ли документ и проходит ли он предикат
+    template <typename DocumentPredicate>
+    bool IsAccepted(const IndexSegment& segment, DocumentOrdinal ordinal, DocumentPredicate& document_predicate) const {
+        if constexpr (IS_BITMAP_FILTER<DocumentPredicate>) {
+            return document_predicate.Accepts(ordinal);
+        } else {
+            return !segment.IsDeleted(ordinal)
+                   && document_predicate(documents_[ordinal].id, documents_[ordinal].status, ratings_.Get(ordinal));
+        }
+    }
+
+    // Мера Жаккара множеств термов, упорядоченных по id; два пустых множества совпадают
+    static double ComputeJaccard(const std::vector<DocumentTerm>& lhs, const std::vector<DocumentTerm>& rhs);
+
+    // Есть ли в индексе почти-дубликатов документ, похожий на документ из этих слов
+    // не меньше, чем на reject_threshold
+    bool IsNearDuplicate(const std::vector<std::string_view>& words) const;
+
+    // Добавляет в index подписи неудалённых документов с порядковыми номерами из [first, last)
+    void IndexNearDuplicates(NearDuplicateIndex& index, DocumentOrdinal first, DocumentOrdinal last) const;
+
+    // Пакеты меньше этого AddDocuments обрабатывает одной частью
+    static constexpr size_t MIN_INDEXING_CHUNK = 1'024;
+
+    // Меньшие диапазоны порядковых номеров параллельная версия не дробит
+    static constexpr size_t MIN_SCORING_RANGE = 4'096;
+
+    // Считает релевантность документов с порядковыми номерами из [first, last)
+    // и отбирает лучшие из них в top. Возвращает число оценённых записей плюс-слов.
+    template <typename DocumentPredicate>
+    size_t ScoreDocuments(const Query& query, DocumentPredicate& document_predicate,
+                          DocumentOrdinal first, DocumentOrdinal last, TopDocuments& top) const;
+
+    // То же для части [first, last), лежащей в одном сегменте
+    template <typename DocumentPredicate>
+    size_t ScoreDocumentsExhaustive(const Query& query, DocumentPredicate& document_predicate, const IndexSegment& segment,
+                                    DocumentOrdinal first, DocumentOrdinal last, TopDocuments& top) const;
+
+    template <typename DocumentPredicate>
+    size_t ScoreDocumentsBlockMaxWand(const Query& query, DocumentPredicate& document_predicate, const IndexSegment& segment,
+                                      DocumentOrdinal first, DocumentOrdinal last, TopDocuments& top) const;
+
+    // Вызывает callback(offset, term_count) для записей из [first, last), offset — смещение от first
+    template <typename Callback>
+    static void ForEachPostingInRange(const PostingList& postings, DocumentOrdinal first, DocumentOrdinal last,
+                                      Callback callback);
+
+    // Помечает исключёнными документы сегмента из [first, last), содержащие минус-слова
+    void ExcludeMinusTerms(const Query& query, const IndexSegment& segment, DocumentOrdinal first, DocumentOrdinal last,
+                           ScoreAccumulator& accumulator) const;
+
+    void UpdateRetrievalStats(const Query& query, size_t postings_scored) const;
 
 template <typename DocumentPredicate>
-std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+TopDocuments FindAllDocuments(const Query& query, DocumentPredicate document_predicate, size_t top_k) const;
     
 template <typename DocumentPredicate, class ExecutionPolicy>
-std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const;           
+TopDocuments FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate, size_t top_k) const;           
 };
 
 template <typename DocumentPredicate, class ExecutionPolicy>
-    std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const {
-        const auto query = ParseQuery(raw_query); 
-  
-        auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-        std::sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < ACCURACY) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-        
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-        return matched_documents;
+    std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                                         size_t top_k) const {
+        QueryLease lease;
+        return FindAllDocuments(policy, ParseQuery(raw_query, lease), document_predicate, top_k).Extract();
     }
     
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate, size_t top_k) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k);
 }
 
 template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status](int, DocumentStatus document_status, int) {
-        return document_status == status;
-    });
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status,
+                                                     size_t top_k) const {
+    const BitmapFilter status_predicate{&GetStatusDocuments(status)};
+    if (!query_cache_) {
+        return FindTopDocuments(policy, raw_query, status_predicate, top_k);
+    }
+    QueryLease lease;
+    const Query& query = ParseQuery(raw_query, lease);
+    std::string key = MakeQueryCacheKey(query, status, top_k);
+    if (auto cached = query_cache_->Get(key, index_version_)) {
+        return std::move(*cached);
+    }
+    auto documents = FindAllDocuments(policy, query, status_predicate, top_k).Extract();
+    query_cache_->Put(std::move(key), index_version_, documents);
+    return documents;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentFilter& filter,
+                                                     size_t top_k) const {
+    QueryLease lease;
+    const Query& query = ParseQuery(raw_query, lease);
+    CompileFilter(filter, *lease);
+    const BitmapFilter filter_predicate{&(*lease).filter_bits};
+    return FindAllDocuments(policy, query, filter_predicate, top_k).Extract();
 }
 
 template <typename ExecutionPolicy>
@@ -192,51 +642,260 @@ SearchServer::SearchServer(const StringContainer& stop_words) : stop_words_(Make
         }
 }
 
-template <typename DocumentPredicate, class ExecutionPolicy>
-std::vector<Document> SearchServer::FindAllDocuments([[maybe_unused]] ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const {
-        ConcurrentMap<int, double> document_to_relevance(LOCKS);
-        std::vector<Document> matched_documents;
+template <typename Callback>
+void SearchServer::ForEachPostingInRange(const PostingList& postings, DocumentOrdinal first, DocumentOrdinal last,
+                                         Callback callback) {
+    auto it = postings.begin();
+    it.SkipTo(first);
+    for (; it != postings.end() && static_cast<DocumentOrdinal>(it->document_id) < last; ++it) {
+        callback(it->document_id - first, it->term_count);
+    }
+}
+
+template <typename DocumentPredicate>
+size_t SearchServer::ScoreDocuments(const Query& query, DocumentPredicate& document_predicate,
+                                    DocumentOrdinal first, DocumentOrdinal last, TopDocuments& top) const {
+    size_t postings_scored = 0;
+    for (const auto& segment : segments_) {
+        const DocumentOrdinal segment_first = std::max(first, segment->GetFirstOrdinal());
+        const DocumentOrdinal segment_last = std::min(last, segment->GetLastOrdinal());
+        if (segment_first >= segment_last) {
+            continue;
+        }
+        if constexpr (IS_BITMAP_FILTER<DocumentPredicate>) {
+            if (!HasBitsInRange(*document_predicate.bits, segment_first, segment_last)) {
+                continue;
+            }
+        }
+        if (retrieval_mode_ == RetrievalMode::BLOCK_MAX_WAND) {
+            postings_scored += ScoreDocumentsBlockMaxWand(query, document_predicate, *segment, segment_first, segment_last, top);
+        } else {
+            postings_scored += ScoreDocumentsExhaustive(query, document_predicate, *segment, segment_first, segment_last, top);
+        }
+    }
+    return postings_scored;
+}
+
+template <typename DocumentPredicate>
+size_t SearchServer::ScoreDocumentsExhaustive(const Query& query, DocumentPredicate& document_predicate,
+                                              const IndexSegment& segment, DocumentOrdinal first, DocumentOrdinal last, TopDocuments& top) const {
+        // накопитель индексируется смещением от first
+        ScoreAccumulator::Lease accumulator(last - first);
         
-        auto plus_word_filter = [this, &document_to_relevance, &document_predicate]
-                                (const std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
+        // минус-слова обрабатываются первыми, чтобы не считать релевантность исключённым документам
+        ExcludeMinusTerms(query, segment, first, last, *accumulator);
+        
+        size_t postings_scored = 0;
+        for (const TermId term_id : query.plus_terms) {
+            // все документы с термом удалены
+            if (term_document_counts_[term_id] == 0) {
+                continue;
             }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& doc_data = documents_.at(document_id);
-                if (document_predicate(document_id, doc_data.status, doc_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(term_id);
+            ForEachPostingInRange(segment.GetPostings(term_id), first, last, [&](DocumentOrdinal offset, uint32_t term_count) {
+                ++postings_scored;
+                // бит карты не дороже состояния накопителя, поэтому непринятые
+                // документы отсекаются до него и не попадают в накопитель вовсе
+                if constexpr (IS_BITMAP_FILTER<DocumentPredicate>) {
+                    if (!document_predicate.Accepts(first + offset)) {
+                        return;
+                    }
                 }
-            }
-        };
+                const auto state = accumulator->GetState(offset);
+                if (state == ScoreAccumulator::State::EXCLUDED) {
+                    return;
+                }
+                // удаление и предикат проверяются один раз, при первой встрече документа
+                if (state == ScoreAccumulator::State::UNTOUCHED && !IsAccepted(segment, first + offset, document_predicate)) {
+                    accumulator->Exclude(offset);
+                    return;
+                }
+                const double term_freq = term_count * documents_[first + offset].inv_word_count;
+                accumulator->Add(offset, term_freq * inverse_document_freq);
+            });
+        }
         
-        auto minus_word_filter = [this, &document_to_relevance]
-                                    (const std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
+        accumulator->ForEachScored([this, first, &top](DocumentOrdinal offset, double relevance) {
+            top.Push({documents_[first + offset].id, relevance, ratings_.Get(first + offset)});
+        });
+        return postings_scored;
+}
+
+template <typename DocumentPredicate>
+size_t SearchServer::ScoreDocumentsBlockMaxWand(const Query& query, DocumentPredicate& document_predicate,
+                                                const IndexSegment& segment, DocumentOrdinal first, DocumentOrdinal last, TopDocuments& top) const {
+    using Cursor = ScoreAccumulator::WandCursor;
+    const int64_t limit = last;
+    auto update_ordinal = [limit](Cursor& cursor) {
+        cursor.ordinal = cursor.it == cursor.end ? limit : std::min<int64_t>(cursor.it->document_id, limit);
+    };
+    auto skip_to = [&update_ordinal](Cursor& cursor, int64_t ordinal) {
+        cursor.it.SkipTo(static_cast<int>(std::min<int64_t>(ordinal, std::numeric_limits<int>::max())));
+        update_ordinal(cursor);
+    };
+
+    ScoreAccumulator::Lease accumulator(last - first);
+    ExcludeMinusTerms(query, segment, first, last, *accumulator);
+
+    // рабочие массивы берутся из накопителя потока и переиспользуются между запросами
+    ScoreAccumulator::WandBuffers& buffers = accumulator->GetWandBuffers();
+    std::vector<Cursor>& cursor_storage = buffers.cursors;
+    cursor_storage.clear();
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        if (term_document_counts_[query.plus_terms[i]] == 0) {
+            continue;
+        }
+        const PostingList& postings = segment.GetPostings(query.plus_terms[i]);
+        const double inverse_document_freq = ComputeWordInverseDocumentFreq(query.plus_terms[i]);
+        Cursor cursor{postings.begin(), postings.end(), i, inverse_document_freq,
+                      inverse_document_freq * postings.MaxWeight()};
+        skip_to(cursor, first);
+        cursor_storage.push_back(cursor);
+    }
+    // курсоры упорядочиваются по текущему номеру через указатели: сами курсоры
+    // крупные, а между итерациями порядок почти не меняется
+    std::vector<Cursor*>& cursors = buffers.order;
+    cursors.clear();
+    for (Cursor& cursor : cursor_storage) {
+        cursors.push_back(&cursor);
+    }
+    // вклады слагаются в порядке плюс-слов, как при полном переборе, чтобы релевантность совпадала до бита
+    std::vector<double>& contributions = buffers.contributions;
+    contributions.assign(query.plus_terms.size(), 0.0);
+    size_t postings_scored = 0;
+
+    while (true) {
+        for (size_t i = 1; i < cursors.size(); ++i) {
+            for (size_t j = i; j > 0 && cursors[j]->ordinal < cursors[j - 1]->ordinal; --j) {
+                std::swap(cursors[j], cursors[j - 1]);
             }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+        }
+        while (!cursors.empty() && cursors.back()->ordinal == limit) {
+            cursors.pop_back();
+        }
+        if (cursors.empty()) {
+            break;
+        }
+        // пока куча не заполнена, порога нет и оценивается каждый документ
+        const bool has_threshold = top.IsFull();
+        if (has_threshold && top.size() == 0) {
+            break;
+        }
+        const double threshold = has_threshold ? top.Worst().relevance - ACCURACY : 0.0;
+
+        // опорный курсор — первый, на котором сумма верхних оценок достигает порога:
+        // документы до его позиции в выдачу попасть не могут
+        size_t pivot = 0;
+        if (has_threshold) {
+            double upper_bound = 0.0;
+            for (; pivot < cursors.size(); ++pivot) {
+                upper_bound += cursors[pivot]->max_score;
+                if (upper_bound >= threshold) {
+                    break;
+                }
             }
-        };
-        
-        std::for_each(policy, std::begin(query.plus_words), std::end(query.plus_words), plus_word_filter);
-        std::for_each(policy, std::begin(query.minus_words), std::end(query.minus_words), minus_word_filter);
-        
-        auto DocsToRelevanceOrdinaryMap = std::move(document_to_relevance.BuildOrdinaryMap());
-        auto matched_word_emplacer = [this, &matched_documents](const auto& pair){
-            matched_documents.emplace_back(pair.first, pair.second, documents_.at(pair.first).rating);
-        };
-        
-        std::for_each(policy, std::begin(DocsToRelevanceOrdinaryMap), std::end(DocsToRelevanceOrdinaryMap), matched_word_emplacer);
-       
-        return matched_documents;
+            if (pivot == cursors.size()) {
+                break;
+            }
+        }
+        const int64_t pivot_ordinal = cursors[pivot]->ordinal;
+        while (pivot + 1 < cursors.size() && cursors[pivot + 1]->ordinal == pivot_ordinal) {
+            ++pivot;
+        }
+
+        if (has_threshold) {
+            // уточняем оценку максимумами блоков, в которые попадает опорный документ;
+            // если её не хватает, пропускаем все эти блоки целиком
+            double block_upper_bound = 0.0;
+            int64_t next_ordinal = pivot + 1 < cursors.size() ? cursors[pivot + 1]->ordinal : limit;
+            for (size_t i = 0; i <= pivot; ++i) {
+                const auto block = cursors[i]->it.PeekBlock(static_cast<int>(pivot_ordinal));
+                block_upper_bound += cursors[i]->inverse_document_freq * block.max_weight;
+                next_ordinal = std::min<int64_t>(next_ordinal, int64_t{block.last_document_id} + 1);
+            }
+            if (block_upper_bound < threshold) {
+                for (size_t i = 0; i <= pivot; ++i) {
+                    skip_to(*cursors[i], next_ordinal);
+                }
+                continue;
+            }
+        }
+
+        if (cursors[0]->ordinal == pivot_ordinal) {
+            const auto offset = static_cast<DocumentOrdinal>(pivot_ordinal - first);
+            postings_scored += pivot + 1;
+            if (accumulator->GetState(offset) != ScoreAccumulator::State::EXCLUDED) {
+                if (IsAccepted(segment, static_cast<DocumentOrdinal>(pivot_ordinal), document_predicate)) {
+                    const auto& doc_data = documents_[pivot_ordinal];
+                    std::fill(contributions.begin(), contributions.end(), 0.0);
+                    for (size_t i = 0; i <= pivot; ++i) {
+                        const double term_freq = cursors[i]->it->term_count * doc_data.inv_word_count;
+                        contributions[cursors[i]->term_index] = term_freq * cursors[i]->inverse_document_freq;
+                    }
+                    double relevance = 0.0;
+                    for (const double contribution : contributions) {
+                        relevance += contribution;
+                    }
+                    top.Push({doc_data.id, relevance, ratings_.Get(static_cast<DocumentOrdinal>(pivot_ordinal))});
+                }
+            }
+            for (size_t i = 0; i <= pivot; ++i) {
+                ++cursors[i]->it;
+                update_ordinal(*cursors[i]);
+            }
+        } else {
+            for (size_t i = 0; i < pivot && cursors[i]->ordinal < pivot_ordinal; ++i) {
+                skip_to(*cursors[i], pivot_ordinal);
+            }
+        }
+    }
+    return postings_scored;
+}
+
+template <typename DocumentPredicate, class ExecutionPolicy>
+TopDocuments SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+                                            size_t top_k) const {
+        if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+            return FindAllDocuments(query, document_predicate, top_k);
+        } else {
+            const size_t document_count = documents_.size();
+            const size_t thread_count = thread_pool_ ? thread_pool_->GetThreadCount()
+                                                     : std::max(1u, std::thread::hardware_concurrency());
+            const size_t range_count = std::min<size_t>(
+                (document_count + MIN_SCORING_RANGE - 1) / MIN_SCORING_RANGE, 4 * thread_count);
+            if (range_count <= 1) {
+                return FindAllDocuments(query, document_predicate, top_k);
+            }
+            // Каждый диапазон порядковых номеров считается независимо в своём
+            // накопителе и своей куче, без общих изменяемых данных; кучи сливаются в конце
+            const size_t range_size = (document_count + range_count - 1) / range_count;
+            std::vector<TopDocuments> range_tops(range_count, TopDocuments(top_k));
+            std::vector<size_t> range_postings_scored(range_count);
+            auto score_range = [&](size_t range) {
+                const auto first = static_cast<DocumentOrdinal>(range * range_size);
+                const auto last = static_cast<DocumentOrdinal>(std::min(document_count, first + range_size));
+                range_postings_scored[range] = ScoreDocuments(query, document_predicate, first, last, range_tops[range]);
+            };
+            if (thread_pool_) {
+                thread_pool_->ParallelFor(range_count, score_range);
+            } else {
+                std::vector<size_t> ranges(range_count);
+                std::iota(ranges.begin(), ranges.end(), 0);
+                std::for_each(policy, ranges.begin(), ranges.end(), score_range);
+            }
+            UpdateRetrievalStats(query, std::accumulate(range_postings_scored.begin(), range_postings_scored.end(), size_t(0)));
+            for (size_t range = 1; range < range_count; ++range) {
+                range_tops[0].Merge(range_tops[range]);
+            }
+            return std::move(range_tops[0]);
+        }
     }
     
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
+TopDocuments SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate, size_t top_k) const {
+    TopDocuments top(top_k);
+    UpdateRetrievalStats(query, ScoreDocuments(query, document_predicate, 0, static_cast<DocumentOrdinal>(documents_.size()), top));
+    return top;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view& document, DocumentStatus status,
@@ -251,7 +910,7 @@ void MatchDocument(ExecutionPolicy&& policy, SearchServer& search_server, const
         std::for_each(policy,
                         std::begin(search_server),
                         std::end(search_server),
-                        [search_server, query](const int document_id) {
+                        [&search_server, query](const int document_id) {
                             const auto [words, status] = search_server.MatchDocument(query, document_id);
                             PrintMatchDocumentResult(document_id, words, status);
                         });
@@ -261,5 +920,3 @@ void MatchDocument(ExecutionPolicy&& policy, SearchServer& search_server, const
 }
 
 void MatchDocument(const SearchServer& search_server, const std::string_view& query);
-
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "snapshot.h"
+#include "checksum.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t section_count;
+    uint64_t file_size;
+    uint64_t checksum;
+    char reserved[24];
+};
+static_assert(sizeof(Header) == SNAPSHOT_ALIGNMENT);
+
+struct SectionEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+size_t Align(size_t size) {
+    return (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+void SnapshotWriter::AddSection() {
+    sections_.emplace_back();
+}
+
+void SnapshotWriter::Append(const void* data, size_t size) {
+    if (sections_.empty()) {
+        throw std::logic_error("SnapshotWriter::Append called before AddSection");
+    }
+    if (size > 0) {
+        sections_.back().push_back({static_cast<const char*>(data), size});
+    }
+}
+
+void SyncParentDirectory(const std::string& path) {
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    if (directory.empty()) {
+        directory = ".";
+    }
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Cannot sync directory " + directory);
+    }
+    close(fd);
+}
+
+void SnapshotWriter::Save(const std::string& path) const {
+    std::vector<SectionEntry> table;
+    size_t offset = Align(sizeof(Header) + sections_.size() * sizeof(SectionEntry));
+    for (const auto& pieces : sections_) {
+        size_t size = 0;
+        for (const Piece& piece : pieces) {
+            size += piece.size;
+        }
+        table.push_back({offset, size, 0, 0});
+        offset = Align(offset + size);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.section_count = sections_.size();
+    header.file_size = offset;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot create " + path);
+    }
+    size_t written = 0;
+    const char zeros[SNAPSHOT_ALIGNMENT] = {};
+    auto write = [&](const char* data, size_t size) {
+        out.write(data, size);
+        written += size;
+    };
+    auto pad = [&] {
+        write(zeros, Align(written) - written);
+    };
+
+    // заголовок и таблица пишутся в конце, когда известны контрольные суммы разделов
+    write(zeros, sizeof(Header));
+    for (size_t i = 0; i < table.size(); ++i) {
+        write(zeros, sizeof(SectionEntry));
+    }
+    pad();
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        Checksum checksum;
+        for (const Piece& piece : sections_[i]) {
+            write(piece.data, piece.size);
+            checksum.Update(piece.data, piece.size);
+        }
+        table[i].checksum = checksum.Finish();
+        pad();
+    }
+    Checksum table_checksum;
+    table_checksum.Update(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SectionEntry));
+    header.checksum = table_checksum.Finish();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SectionEntry));
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+    // снимок служит контрольной точкой журнала, поэтому должен дойти до диска
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Cannot sync " + path);
+    }
+    close(fd);
+    SyncParentDirectory(path);
+}
+
+SnapshotReader::SnapshotReader(const std::string& path) : path_(path), file_(path) {
+    const char* data = file_.data();
+    const size_t size = file_.size();
+    if (size < sizeof(Header)) {
+        throw std::runtime_error(path + " is not a search server snapshot");
+    }
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error(path + " is not a search server snapshot");
+    }
+    if (header.version != SNAPSHOT_VERSION || header.byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error(path + " has unsupported snapshot version or byte order");
+    }
+    if (header.file_size != size
+        || header.section_count > (size - sizeof(Header)) / sizeof(SectionEntry)) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    const char* table = data + sizeof(Header);
+    Checksum checksum;
+    checksum.Update(table, header.section_count * sizeof(SectionEntry));
+    if (checksum.Finish() != header.checksum) {
+        throw std::runtime_error(path + " is corrupted: section table checksum mismatch");
+    }
+
+    for (size_t i = 0; i < header.section_count; ++i) {
+        SectionEntry entry;
+        std::memcpy(&entry, table + i * sizeof(SectionEntry), sizeof(entry));
+        if (entry.offset % SNAPSHOT_ALIGNMENT != 0 || entry.offset > size || entry.size > size - entry.offset) {
+            throw std::runtime_error(path + " has invalid section table");
+        }
+        sections_.push_back({{data + entry.offset, entry.size}, entry.checksum});
+    }
+    verified_ = std::make_unique<std::atomic<bool>[]>(sections_.size());
+}
+
+std::string_view SnapshotReader::GetSection(size_t index) const {
+    VerifySection(index);
+    return sections_[index].data;
+}
+
+std::string_view SnapshotReader::GetUnverifiedSection(size_t index) const {
+    if (index >= sections_.size()) {
+        throw std::runtime_error("Snapshot has no section " + std::to_string(index));
+    }
+    return sections_[index].data;
+}
+
+void SnapshotReader::VerifySection(size_t index) const {
+    const std::string_view section = GetUnverifiedSection(index);
+    if (verified_[index].load(std::memory_order_acquire)) {
+        return;
+    }
+    Checksum checksum;
+    checksum.Update(section.data(), section.size());
+    if (checksum.Finish() != sections_[index].checksum) {
+        throw std::runtime_error(path_ + " is corrupted: checksum mismatch in section " + std::to_string(index));
+    }
+    verified_[index].store(true, std::memory_order_release);
+}
+
+void SnapshotReader::VerifyAll() const {
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        VerifySection(i);
+    }
+}
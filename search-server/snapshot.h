@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Формат снимка: 64-байтный заголовок (сигнатура, версия, порядок байт,
+// число разделов, размер файла и контрольная сумма таблицы), таблица разделов
+// (смещение, размер и контрольная сумма каждого) и сами разделы. Таблица и каждый
+// раздел начинаются с границы SNAPSHOT_ALIGNMENT, поэтому массивы записей
+// в разделах можно читать прямо из отображённой памяти. Своя контрольная сумма
+// у каждого раздела позволяет проверять только те разделы, которые читаются.
+constexpr size_t SNAPSHOT_ALIGNMENT = 64;
+constexpr uint32_t SNAPSHOT_VERSION = 4;
+
+// Сбрасывает на диск каталог, в котором лежит path: без этого созданный
+// или переименованный файл может пропасть из каталога при сбое ОС
+void SyncParentDirectory(const std::string& path);
+
+// Пишет снимок из разделов. Раздел может собираться из нескольких кусков;
+// данные кусков не копируются и должны жить до вызова Save.
+class SnapshotWriter {
+public:
+    // Начинает новый раздел; разделы нумеруются подряд с нуля
+    void AddSection();
+
+    // Дописывает кусок в текущий раздел
+    void Append(const void* data, size_t size);
+
+    template <typename T>
+    void AppendArray(const std::vector<T>& items) {
+        Append(items.data(), items.size() * sizeof(T));
+    }
+
+    void Save(const std::string& path) const;
+
+private:
+    struct Piece {
+        const char* data;
+        size_t size;
+    };
+
+    std::vector<std::vector<Piece>> sections_;
+};
+
+// Отображает снимок в память и проверяет заголовок и таблицу разделов.
+// Контрольная сумма раздела проверяется при первом GetSection или VerifySection,
+// поэтому загрузка не читает разделов, которые нужны только из отображения.
+// При ошибке выбрасывает std::runtime_error.
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const std::string& path);
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    size_t GetSectionCount() const {
+        return sections_.size();
+    }
+
+    // Раздел с проверенной контрольной суммой
+    std::string_view GetSection(size_t index) const;
+
+    // Раздел без проверки содержимого: для данных, которые читаются прямо
+    // из отображения по мере надобности; проверить их можно позже через VerifySection
+    std::string_view GetUnverifiedSection(size_t index) const;
+
+    // Проверяет контрольную сумму раздела, если она ещё не проверена. Безопасно
+    // вызывать из нескольких потоков.
+    void VerifySection(size_t index) const;
+
+    // Проверяет все ещё не проверенные разделы
+    void VerifyAll() const;
+
+    // Раздел как массив записей T, лежащих прямо в отображённой памяти
+    template <typename T>
+    const T* GetArray(size_t index, size_t& count) const {
+        return AsArray<T>(index, GetSection(index), count);
+    }
+
+    template <typename T>
+    const T* GetUnverifiedArray(size_t index, size_t& count) const {
+        return AsArray<T>(index, GetUnverifiedSection(index), count);
+    }
+
+private:
+    struct Section {
+        std::string_view data;
+        uint64_t checksum = 0;
+    };
+
+    std::string path_;
+    MappedFile file_;
+    std::vector<Section> sections_;
+    // проверенные разделы; гонка двух проверок одного раздела безвредна
+    std::unique_ptr<std::atomic<bool>[]> verified_;
+
+    template <typename T>
+    static const T* AsArray(size_t index, std::string_view section, size_t& count) {
+        if (section.size() % sizeof(T) != 0) {
+            throw std::runtime_error("Snapshot section " + std::to_string(index) + " has invalid size");
+        }
+        count = section.size() / sizeof(T);
+        return reinterpret_cast<const T*>(section.data());
+    }
+};
@@ -1,20 +1,199 @@
 #include "string_processing.h"
 
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+// Текст обрабатывается блоками по 64 байта: векторная часть строит маску
+// пробелов блока, а границы слов — это смены бита в маске
+constexpr size_t BLOCK_SIZE = 64;
+
+class WordCollector {
+public:
+    WordCollector(std::string_view text, std::vector<std::string_view>& words)
+        : text_(text)
+        , words_(words) {
+    }
+
+    // spaces — маска пробелов блока, начинающегося с offset
+    void AddBlock(size_t offset, uint64_t spaces) {
+        const uint64_t word_bytes = ~spaces;
+        uint64_t transitions = word_bytes ^ (word_bytes << 1 | in_word_);
+        in_word_ = word_bytes >> 63;
+        while (transitions != 0) {
+            const size_t pos = offset + __builtin_ctzll(transitions);
+            if (word_begin_ == NO_WORD) {
+                word_begin_ = pos;
+            } else {
+                words_.emplace_back(text_.data() + word_begin_, pos - word_begin_);
+                word_begin_ = NO_WORD;
+            }
+            transitions &= transitions - 1;
+        }
+    }
+
+    void Finish() {
+        if (word_begin_ != NO_WORD) {
+            words_.emplace_back(text_.data() + word_begin_, text_.size() - word_begin_);
+        }
+    }
+
+private:
+    static constexpr size_t NO_WORD = static_cast<size_t>(-1);
+
+    std::string_view text_;
+    std::vector<std::string_view>& words_;
+    uint64_t in_word_ = 0;
+    size_t word_begin_ = NO_WORD;
+};
+
+bool IsControl(char c) {
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+bool SplitScalar(std::string_view text, std::vector<std::string_view>& words) {
+    bool valid = true;
+    size_t word_begin = 0;
+    bool in_word = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        valid &= !IsControl(c);
+        if (c == ' ') {
+            if (in_word) {
+                words.emplace_back(text.data() + word_begin, i - word_begin);
+                in_word = false;
+            }
+        } else if (!in_word) {
+            word_begin = i;
+            in_word = true;
+        }
+    }
+    if (in_word) {
+        words.emplace_back(text.data() + word_begin, text.size() - word_begin);
+    }
+    return valid;
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+
+// Блок текста с началом в offset; хвост короче блока копируется в буфер,
+// добитый пробелами, чтобы не читать за границей текста
+const char* GetBlock(std::string_view text, size_t offset, char* tail) {
+    if (offset + BLOCK_SIZE <= text.size()) {
+        return text.data() + offset;
+    }
+    std::memset(tail, ' ', BLOCK_SIZE);
+    std::memcpy(tail, text.data() + offset, text.size() - offset);
+    return tail;
+}
+
+// Управляющие символы — байты не больше 31 без знака: min(x, 31) == x
+__attribute__((target("sse2"))) bool SplitSse2(std::string_view text, std::vector<std::string_view>& words) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    WordCollector collector(text, words);
+    __m128i control = _mm_setzero_si128();
+    alignas(BLOCK_SIZE) char tail[BLOCK_SIZE];
+    for (size_t offset = 0; offset < text.size(); offset += BLOCK_SIZE) {
+        const char* data = GetBlock(text, offset, tail);
+        uint64_t spaces = 0;
+        for (size_t i = 0; i < BLOCK_SIZE; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            spaces |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, space)))) << i;
+            control = _mm_or_si128(control, _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes));
+        }
+        collector.AddBlock(offset, spaces);
+    }
+    collector.Finish();
+    return _mm_movemask_epi8(control) == 0;
+}
+
+__attribute__((target("avx2"))) bool SplitAvx2(std::string_view text, std::vector<std::string_view>& words) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    WordCollector collector(text, words);
+    __m256i control = _mm256_setzero_si256();
+    alignas(BLOCK_SIZE) char tail[BLOCK_SIZE];
+    for (size_t offset = 0; offset < text.size(); offset += BLOCK_SIZE) {
+        const char* data = GetBlock(text, offset, tail);
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+        const uint64_t spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, space)))
+                              | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, space)))) << 32;
+        control = _mm256_or_si256(control, _mm256_cmpeq_epi8(_mm256_min_epu8(low, last_control), low));
+        control = _mm256_or_si256(control, _mm256_cmpeq_epi8(_mm256_min_epu8(high, last_control), high));
+        collector.AddBlock(offset, spaces);
+    }
+    collector.Finish();
+    return _mm256_testz_si256(control, control);
+}
+
+#endif
+
+}  // namespace
+
 std::vector<std::string_view> SplitIntoWords(const std::string_view& str_orig) {
     std::vector<std::string_view> result;
-    std::string_view str = str_orig;
-    // 1
-    int64_t pos = str.find_first_not_of(" ");
-    // 2
-    const int64_t pos_end = str.npos;
-    // 3
-    while (pos != pos_end) {
-        // 4
-        int64_t space = str.find(' ', pos);
-        // 5
-        result.push_back(space == pos_end ? str.substr(pos) : str.substr(pos, space - pos));
-        // 6
-        pos = str.find_first_not_of(" ", space);
-    }
+    SplitIntoWords(str_orig, result);
     return result;
-}
\ No newline at end of file
+}
+
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    static const TokenizerPath path = GetTokenizerPath();
+    return SplitIntoWords(text, words, path);
+}
+
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words, TokenizerPath path) {
+    switch (path) {
+    case TokenizerPath::SCALAR:
+        return SplitScalar(text, words);
+#ifdef SEARCH_SERVER_X86_SIMD
+    case TokenizerPath::SSE2:
+        if (IsTokenizerPathSupported(path)) {
+            return SplitSse2(text, words);
+        }
+        break;
+    case TokenizerPath::AVX2:
+        if (IsTokenizerPathSupported(path)) {
+            return SplitAvx2(text, words);
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    throw std::invalid_argument("Tokenizer path is not supported by this CPU"s);
+}
+
+bool IsTokenizerPathSupported(TokenizerPath path) {
+    switch (path) {
+    case TokenizerPath::SCALAR:
+        return true;
+#ifdef SEARCH_SERVER_X86_SIMD
+    case TokenizerPath::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case TokenizerPath::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+TokenizerPath GetTokenizerPath() {
+    for (const TokenizerPath path : {TokenizerPath::AVX2, TokenizerPath::SSE2}) {
+        if (IsTokenizerPathSupported(path)) {
+            return path;
+        }
+    }
+    return TokenizerPath::SCALAR;
+}
@@ -6,8 +6,29 @@
 #include <set>
 #include <iostream>
 
+// Реализации разбиения текста на слова
+enum class TokenizerPath {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
 std::vector<std::string_view> SplitIntoWords(const std::string_view& str_orig);
 
+// Дописывает в words слова текста, разделённые пробелами, за один проход,
+// заодно проверяя текст на управляющие символы (коды 0-31).
+// Возвращает false, если они встретились; слова при этом всё равно разобраны.
+// Реализация выбирается по возможностям процессора при первом вызове.
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
+// То же с явно заданной реализацией; неподдерживаемая даёт invalid_argument
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words, TokenizerPath path);
+
+bool IsTokenizerPathSupported(TokenizerPath path);
+
+// Самая быстрая из поддерживаемых реализаций
+TokenizerPath GetTokenizerPath();
+
 template <typename StringContainer>
 std::set<std::string_view> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string_view> non_empty_strings;
@@ -17,4 +38,4 @@ std::set<std::string_view> MakeUniqueNonEmptyStrings(const StringContainer& stri
         }
     }
     return non_empty_strings;
-}
\ No newline at end of file
+}
@@ -0,0 +1,29 @@
+#include "term_dictionary.h"
+
+TermDictionary::TermId TermDictionary::Intern(std::string_view word) {
+    if (const auto it = word_to_id_.find(word); it != word_to_id_.end()) {
+        return it->second;
+    }
+    return Add(owned_words_.emplace_back(word));
+}
+
+TermDictionary::TermId TermDictionary::InternExternal(std::string_view word) {
+    if (const auto it = word_to_id_.find(word); it != word_to_id_.end()) {
+        return it->second;
+    }
+    return Add(word);
+}
+
+std::optional<TermDictionary::TermId> TermDictionary::Find(std::string_view word) const {
+    if (const auto it = word_to_id_.find(word); it != word_to_id_.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+TermDictionary::TermId TermDictionary::Add(std::string_view stored) {
+    const auto term_id = static_cast<TermId>(words_.size());
+    words_.push_back(stored);
+    word_to_id_.emplace(stored, term_id);
+    return term_id;
+}
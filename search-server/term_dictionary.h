@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Словарь термов: каждому проиндексированному слову один раз назначается
+// плотный 32-битный id, по которому дальше работают все структуры индекса.
+// Строки термов хранятся в самом словаре, поэтому возвращаемые string_view
+// остаются валидными всё время жизни словаря. Строки, добавленные через
+// InternExternal, не копируются и должны жить не меньше словаря.
+class TermDictionary {
+public:
+    using TermId = uint32_t;
+
+    // Возвращает id слова, добавляя его в словарь при первой встрече
+    TermId Intern(std::string_view word);
+
+    // То же без копирования строки (например, из отображённого снимка)
+    TermId InternExternal(std::string_view word);
+
+    std::optional<TermId> Find(std::string_view word) const;
+
+    std::string_view GetWord(TermId term_id) const {
+        return words_[term_id];
+    }
+
+    size_t size() const {
+        return words_.size();
+    }
+
+private:
+    // строки термов по id: свои из owned_words_ или внешние
+    std::vector<std::string_view> words_;
+    std::deque<std::string> owned_words_;
+    std::unordered_map<std::string_view, TermId> word_to_id_;
+
+    TermId Add(std::string_view stored);
+};
@@ -0,0 +1,124 @@
+#include "test_allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Все варианты operator new выделяют память через malloc или aligned_alloc,
+// а все варианты operator delete освобождают её через free, так что любая пара
+// new и delete согласована, в том числе для стандартной библиотеки и санитайзеров.
+// noinline: встроенные malloc и free GCC считает непарными operator new и delete.
+
+namespace {
+
+thread_local size_t thread_allocation_count = 0;
+
+void* Allocate(size_t size) noexcept {
+    ++thread_allocation_count;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* AllocateAligned(size_t size, std::align_val_t alignment) noexcept {
+    ++thread_allocation_count;
+    const auto align = static_cast<size_t>(alignment);
+    // aligned_alloc требует размер, кратный выравниванию
+    const size_t rounded = (size == 0 ? align : (size + align - 1) / align * align);
+    return std::aligned_alloc(align, rounded);
+}
+
+}  // namespace
+
+size_t GetThreadAllocationCount() {
+    return thread_allocation_count;
+}
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    if (void* ptr = Allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+    if (void* ptr = Allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+__attribute__((noinline)) void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return Allocate(size);
+}
+
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* ptr = AllocateAligned(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t size, std::align_val_t alignment) {
+    if (void* ptr = AllocateAligned(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+__attribute__((noinline)) void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateAligned(size, alignment);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
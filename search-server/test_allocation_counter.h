@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+// Число выделений памяти через operator new в текущем потоке. Замена всех
+// вариантов operator new и delete — в test_allocation_counter.cpp: тесты
+// проверяют по счётчику, что горячие пути не обращаются к куче.
+size_t GetThreadAllocationCount();
+
+template <typename Func>
+size_t CountAllocations(Func func) {
+    const size_t before = GetThreadAllocationCount();
+    func();
+    return GetThreadAllocationCount() - before;
+}
@@ -1,16 +1,35 @@
 #pragma once
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <new>
 #include <set>
 #include <sstream>
 #include <string>
 #include <random>
 #include <execution>
+#include <shared_mutex>
+#include <thread>
 
 #include "search_server.h"
+#include "concurrent_search_server.h"
 #include "process_queries.h"
+#include "remove_duplicates.h"
+#include "snapshot.h"
+#include "request_queue.h"
 #include "concurrent_map.h"
+#include "numeric_column.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "text_arena.h"
+#include "thread_pool.h"
+#include "test_allocation_counter.h"
 #include "test_framework.h"
 
 using namespace std;
@@ -291,6 +310,28 @@ void TestMatchedSize(){
     std::cerr << "Test Matched Size - OK\n"s;
 }
 
+// Тест проверяет удаление документа и повторное добавление документа с тем же id
+void TestRemoveDocument() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and fluffy tail"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "fluffy dog"s, DocumentStatus::ACTUAL, {3});
+
+    server.RemoveDocument(1);
+    server.RemoveDocument(execution::par, 1);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT(server.GetWordFrequencies(1).empty());
+    ASSERT_THROWS(server.MatchDocument("cat"s, 1), out_of_range);
+    const auto cats = server.FindTopDocuments("cat fluffy"s);
+    ASSERT_EQUAL(cats.size(), 2u);
+    ASSERT(none_of(cats.begin(), cats.end(), [](const Document& document) { return document.id == 1; }));
+
+    server.AddDocument(1, "grey cat"s, DocumentStatus::ACTUAL, {4});
+    ASSERT_EQUAL(server.GetDocumentCount(), 3);
+    ASSERT_EQUAL(get<0>(server.MatchDocument("grey fluffy"s, 1)), vector<string_view>{"grey"sv});
+    ASSERT_EQUAL(server.FindTopDocuments("grey"s).at(0).id, 1);
+}
+
 // Тестируем рабору ProcessQueries + параллельность
 // Как заставить LOG_DURATION работать в nanosec?
 void TestMyProcessQueries(){
@@ -392,18 +433,120 @@ void TestConcurrentReadAndWrite() {
     }
 }
 
-void TestConcurrentSpeedup() {
-    {
-        ConcurrentMap<int, int> single_lock(1);
+void RunConcurrentReads(const ConcurrentMap<int, int>& cm, size_t thread_count, int key_count) {
+    auto kernel = [&cm, key_count](int seed) {
+        vector<int> keys(key_count);
+        iota(begin(keys), end(keys), -key_count / 2);
+        shuffle(begin(keys), end(keys), mt19937(seed));
 
-        LOG_DURATION("Single lock");
-        RunConcurrentUpdates(single_lock, 4, 50000);
+        int64_t sum = 0;
+        for (auto key : keys) {
+            sum += cm.Find(key).value_or(0);
+        }
+        return sum;
+    };
+
+    vector<future<int64_t>> futures;
+    for (size_t i = 0; i < thread_count; ++i) {
+        futures.push_back(async(kernel, i));
     }
-    {
-        ConcurrentMap<int, int> many_locks(3000);
+    for (auto& f : futures) {
+        f.get();
+    }
+}
+
+// Тест проверяет, что SharedSpinLock исключает писателя из чтения и что писатель
+// получает замок, даже когда читатели держат его без перерывов
+void TestSharedSpinLock() {
+    SharedSpinLock lock;
+    // писатель меняет пару под замком, читатели не должны увидеть её половинчатой
+    int first = 0;
+    int second = 0;
+    atomic<bool> stop = false;
+    atomic<bool> torn = false;
+    vector<thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!stop.load(memory_order_relaxed)) {
+                lock.lock_shared();
+                if (first != second) {
+                    torn = true;
+                }
+                // читатели держат замок внахлёст, так что без бита намерения он почти не бывает свободен
+                this_thread::sleep_for(chrono::microseconds(50));
+                lock.unlock_shared();
+            }
+        });
+    }
+    const auto start = chrono::steady_clock::now();
+    for (int i = 0; i < 200; ++i) {
+        lock.lock();
+        ++first;
+        ++second;
+        lock.unlock();
+    }
+    const auto elapsed = chrono::steady_clock::now() - start;
+    stop = true;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    ASSERT(!torn);
+    ASSERT_EQUAL(first, 200);
+    ASSERT(elapsed < chrono::seconds(10));
+}
+
+void TestConcurrentMapOperations() {
+    // одна часть, чтобы все ключи сталкивались в одной хеш-таблице
+    ConcurrentMap<int, string> cm(1);
+    for (int key = -500; key < 500; ++key) {
+        cm[key].ref_to_value = to_string(key);
+    }
+    for (int key = -500; key < 500; key += 2) {
+        ASSERT_EQUAL(cm.erase(key), 1u);
+    }
+    ASSERT_EQUAL(cm.erase(-500), 0u);
+    for (int key = -500; key < 500; ++key) {
+        const auto value = cm.Find(key);
+        if (key % 2 == 0) {
+            ASSERT(!value);
+        } else {
+            ASSERT_EQUAL(*value, to_string(key));
+        }
+    }
+
+    atomic<int> visited = 0;
+    cm.ForEach([&visited](int key, const string& value) {
+        ASSERT_EQUAL(value, to_string(key));
+        ++visited;
+    });
+    ASSERT_EQUAL(visited.load(), 500);
+
+    const auto ordinary = cm.BuildOrdinaryMap();
+    ASSERT_EQUAL(ordinary.size(), 500u);
+    ASSERT_EQUAL(ordinary.begin()->first, -499);
+}
 
-        LOG_DURATION("3'000 locks");
-        RunConcurrentUpdates(many_locks, 4, 50000);
+// Нагрузочный тест: обновления и чтения при разном числе потоков и частей словаря
+void TestConcurrentSpeedup() {
+    constexpr int KEY_COUNT = 50000;
+    for (const size_t thread_count : {1, 4}) {
+        for (const size_t chunk_count : {1, 64, 3000}) {
+            const string mark = to_string(thread_count) + " threads, "s + to_string(chunk_count) + " chunks"s;
+            ConcurrentMap<int, int> cm(chunk_count);
+            {
+                LOG_DURATION("Updates, "s + mark);
+                RunConcurrentUpdates(cm, thread_count, KEY_COUNT);
+            }
+            {
+                LOG_DURATION("Reads, "s + mark);
+                RunConcurrentReads(cm, thread_count, KEY_COUNT);
+            }
+            {
+                LOG_DURATION("BuildOrdinaryMap, "s + mark);
+                const auto result = cm.BuildOrdinaryMap();
+                ASSERT_EQUAL(result.size(), static_cast<size_t>(KEY_COUNT));
+            }
+        }
     }
 }
 
@@ -441,6 +584,20 @@ string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int w
     return query;
 }
 
+// Текст с неравномерной частотой слов: слова из начала словаря встречаются
+// намного чаще, как в естественном языке
+string GenerateSkewedText(mt19937& generator, const vector<string>& dictionary, int word_count) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        const double x = uniform_real_distribution<>(0, 1)(generator);
+        text += dictionary[static_cast<size_t>(x * x * x * dictionary.size())];
+    }
+    return text;
+}
+
 vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
     vector<string> queries;
     queries.reserve(query_count);
@@ -450,19 +607,1806 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
+// Тест проверяет кодирование списка вхождений, переходы между блоками и SkipTo
+void TestPostingList() {
+    PostingList list;
+    vector<PostingList::Posting> expected;
+    for (int id = 0; id < 1000; ++id) {
+        if (id % 3 == 0) {
+            list.Append(id * 1000, id % 7 + 1, (id % 7 + 1) * 0.1);
+            expected.push_back({id * 1000, static_cast<uint32_t>(id % 7 + 1)});
+        }
+    }
+    ASSERT_EQUAL(list.size(), expected.size());
+    size_t i = 0;
+    for (const auto [document_id, term_count] : list) {
+        ASSERT_EQUAL(document_id, expected[i].document_id);
+        ASSERT_EQUAL(term_count, expected[i].term_count);
+        ++i;
+    }
+    ASSERT_EQUAL(i, expected.size());
+
+    ASSERT(list.Contains(999'000));
+    ASSERT(!list.Contains(1'000));
+    auto it = list.begin();
+    it.SkipTo(500'001);
+    ASSERT_EQUAL(it->document_id, 501'000);
+    it.SkipTo(1'000'000);
+    ASSERT(it == list.end());
+    ASSERT_THROWS(list.Append(5, 1, 0.1), invalid_argument);
+
+    ASSERT(std::abs(list.MaxWeight() - 0.7) < ACCURACY);
+    // Block-Max: граница блока не меньше искомого id, вес блока — максимум его записей
+    const auto block = list.begin().PeekBlock(500'001);
+    ASSERT(block.last_document_id >= 501'000);
+    ASSERT(block.max_weight > 0.0);
+    ASSERT_EQUAL(list.begin().PeekBlock(1'000'000).max_weight, 0.0);
+
+    list.Insert(1'000, 2, 5.0);
+    ASSERT(list.Contains(1'000));
+    ASSERT_EQUAL(list.MaxWeight(), 5.0);
+    ASSERT_EQUAL(list.Erase(1'000), 1u);
+    ASSERT_EQUAL(list.Erase(1'000), 0u);
+    ASSERT_EQUAL(list.size(), expected.size());
+}
+
+// Тест проверяет, что словарь выдаёт каждому слову один и тот же плотный id
+void TestTermDictionary() {
+    TermDictionary terms;
+    string word = "cat"s;
+    const auto cat_id = terms.Intern(word);
+    const auto dog_id = terms.Intern("dog"sv);
+    word = "dog"s;
+    ASSERT_EQUAL(cat_id, 0u);
+    ASSERT_EQUAL(dog_id, 1u);
+    ASSERT_EQUAL(terms.Intern(word), dog_id);
+    ASSERT_EQUAL(terms.GetWord(cat_id), "cat"sv);
+    ASSERT(terms.Find("cat"sv) == cat_id);
+    ASSERT(!terms.Find("bird"sv));
+    ASSERT_EQUAL(terms.size(), 2u);
+
+    // внешняя строка не копируется, а уже известное слово сохраняет свой id
+    const string_view external = "bird"sv;
+    const auto bird_id = terms.InternExternal(external);
+    ASSERT_EQUAL(bird_id, 2u);
+    ASSERT(terms.GetWord(bird_id).data() == external.data());
+    ASSERT_EQUAL(terms.InternExternal("cat"sv), cat_id);
+}
+
+// Сравнивает список вхождений на std::map с PostingList:
+// сколько байт уходит на одно вхождение и как быстро обходятся все списки
+void TestPostingListBenchmark() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+
+    map<string_view, map<int, double>> word_to_document_freqs;
+    map<string_view, PostingList> word_to_postings;
+    size_t posting_count = 0;
+    for (size_t id = 0; id < documents.size(); ++id) {
+        const auto words = SplitIntoWords(documents[id]);
+        map<string_view, uint32_t> word_counts;
+        for (const string_view word : words) {
+            ++word_counts[word];
+        }
+        for (const auto [word, count] : word_counts) {
+            word_to_document_freqs[word][id] = count * 1.0 / words.size();
+            word_to_postings[word].Append(id, count, count * 1.0 / words.size());
+            ++posting_count;
+        }
+    }
+
+    // узел красно-чёрного дерева: три указателя, цвет и сама пара
+    const size_t map_node_size = 4 * sizeof(void*) + sizeof(pair<const int, double>);
+    size_t posting_list_bytes = 0;
+    for (const auto& [word, postings] : word_to_postings) {
+        posting_list_bytes += postings.MemoryUsage();
+    }
+    std::cerr << "std::map bytes per posting: "s << map_node_size << std::endl;
+    std::cerr << "PostingList bytes per posting: "s << posting_list_bytes * 1.0 / posting_count << std::endl;
+
+    const int passes = 20;
+    double map_sum = 0;
+    uint64_t list_sum = 0;
+    {
+        LOG_DURATION("std::map scan"s);
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const auto& [word, freqs] : word_to_document_freqs) {
+                for (const auto [document_id, term_freq] : freqs) {
+                    map_sum += term_freq;
+                }
+            }
+        }
+    }
+    {
+        LOG_DURATION("PostingList scan"s);
+        for (int pass = 0; pass < passes; ++pass) {
+            for (const auto& [word, postings] : word_to_postings) {
+                for (const auto [document_id, term_count] : postings) {
+                    list_sum += term_count;
+                }
+            }
+        }
+    }
+    std::cerr << "Postings scanned per pass: "s << posting_count << std::endl;
+    // в каждом документе ровно 70 слов, а сумма частот слов документа равна единице
+    ASSERT_EQUAL(list_sum, static_cast<uint64_t>(passes) * 70 * documents.size());
+    ASSERT(std::abs(map_sum - passes * documents.size()) < 1e-3);
+}
+
+// Тест проверяет, что top_k ограничивает выдачу, а отбор через кучу
+// (последовательный и параллельный) совпадает с полной сортировкой
+void TestTopK() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 100, 5);
+    const auto documents = GenerateQueries(generator, dictionary, 2'000, 10);
+    SearchServer search_server;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)});
+    }
+    const string query = GenerateQuery(generator, dictionary, 5);
+
+    const auto all = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, documents.size());
+    const auto top_seq = search_server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 50);
+    const auto top_par = search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 50);
+    ASSERT(all.size() > 50u);
+    ASSERT(is_sorted(all.begin(), all.end(), IsMoreRelevant));
+    ASSERT_EQUAL(top_seq.size(), 50u);
+    ASSERT_EQUAL(top_par.size(), 50u);
+    for (size_t i = 0; i < top_seq.size(); ++i) {
+        ASSERT(std::abs(top_seq[i].relevance - all[i].relevance) < ACCURACY);
+        ASSERT(std::abs(top_par[i].relevance - all[i].relevance) < ACCURACY);
+        ASSERT_EQUAL(top_par[i].rating, top_seq[i].rating);
+    }
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 0).empty());
+}
+
+// Тест проверяет, что закэшированные IDF пересчитываются после добавления и удаления документов
+void TestIdfCache() {
+    const vector<string> texts = {"cat in the city"s, "dog in the town"s, "cat and dog"s, "bird"s};
+    SearchServer search_server;
+    SearchServer reference;
+    for (int id = 0; id < 2; ++id) {
+        search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+    }
+    // заполняем кэш до изменения индекса
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat dog"s).size(), 2u);
+    for (int id = 2; id < 4; ++id) {
+        search_server.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+    }
+    search_server.RemoveDocument(1);
+    for (const int id : {0, 2, 3}) {
+        reference.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+    }
+    for (const string_view query : {"cat dog"sv, "cat"sv, "bird -dog"sv}) {
+        const auto actual = search_server.FindTopDocuments(query);
+        const auto expected = reference.FindTopDocuments(query);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            ASSERT_EQUAL(actual[i].id, expected[i].id);
+            ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+        }
+    }
+}
+
+// Тест проверяет, что хранилище текстов возвращает сохранённые тексты,
+// переиспользует освобождённые id и уплотняется после массового удаления
+void TestTextArena() {
+    TextArena arena;
+    vector<string> texts;
+    vector<TextArena::TextId> ids;
+    for (int i = 0; i < 10'000; ++i) {
+        texts.push_back(string(i % 300, static_cast<char>('a' + i % 26)));
+        ids.push_back(arena.Add(texts.back()));
+    }
+    const string long_text(TextArena::CHUNK_SIZE + 1, 'x');
+    const auto long_id = arena.Add(long_text);
+    ASSERT_EQUAL(arena.Get(long_id), long_text);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        ASSERT_EQUAL(arena.Get(ids[i]), texts[i]);
+    }
+    ASSERT_EQUAL(arena.size(), texts.size() + 1);
+
+    const size_t memory_before = arena.MemoryUsage();
+    arena.Release(long_id);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (i % 4 != 0) {
+            arena.Release(ids[i]);
+        }
+    }
+    ASSERT_THROWS(arena.Get(ids[1]), out_of_range);
+    // освобождённых байт стало больше живых — хранилище уплотнилось само
+    ASSERT(arena.MemoryUsage() < memory_before);
+    arena.Compact();
+    ASSERT(arena.MemoryUsage() < memory_before / 2);
+    for (size_t i = 0; i < texts.size(); i += 4) {
+        ASSERT_EQUAL(arena.Get(ids[i]), texts[i]);
+    }
+    ASSERT_EQUAL(arena.size(), texts.size() / 4);
+    const auto reused_id = arena.Add("reused"sv);
+    ASSERT(reused_id < ids.size());
+    ASSERT_EQUAL(arena.Get(reused_id), "reused"sv);
+
+    // тексты из внешнего блока не копируются, пока хранилище не уплотнится
+    const string block = "white cat"s + "black dog"s;
+    const size_t memory_with_block = arena.MemoryUsage();
+    const auto external_block = arena.AttachExternal(block);
+    const auto cat_id = arena.AddExternal(external_block, 0, 9);
+    const auto dog_id = arena.AddExternal(external_block, 9, 9);
+    ASSERT_THROWS(arena.AddExternal(external_block, 10, 9), out_of_range);
+    ASSERT(arena.Get(cat_id).data() == block.data());
+    ASSERT_EQUAL(arena.Get(dog_id), "black dog"sv);
+    ASSERT(arena.MemoryUsage() < memory_with_block + TextArena::CHUNK_SIZE);
+    arena.Add("after"sv);
+    arena.Compact();
+    ASSERT_EQUAL(arena.Get(cat_id), "white cat"sv);
+    ASSERT(arena.Get(cat_id).data() != block.data());
+}
+
+// Тест проверяет, что пакетное добавление строит тот же индекс, что и AddDocument
+// по одному, и сравнивает скорость обоих способов в документах в секунду
+void TestAddDocuments() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 20'000, 70);
+    vector<SearchServer::NewDocument> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        batch.push_back({static_cast<int>(i * 2), texts[i], i % 3 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+                         {static_cast<int>(i % 10), 1}});
+    }
+
+    auto documents_per_second = [&batch](chrono::steady_clock::duration duration) {
+        return static_cast<int64_t>(batch.size() / max(chrono::duration<double>(duration).count(), 1e-9));
+    };
+    SearchServer one_by_one(dictionary[0]);
+    auto start = chrono::steady_clock::now();
+    for (const auto& document : batch) {
+        one_by_one.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    std::cerr << "AddDocument: "s << documents_per_second(chrono::steady_clock::now() - start) << " docs/s"s << std::endl;
+
+    SearchServer bulk(dictionary[0]);
+    // первая половина по одному, вторая пакетом — пакет должен продолжить существующий индекс
+    const vector<SearchServer::NewDocument> first_half(batch.begin(), batch.begin() + batch.size() / 2);
+    const vector<SearchServer::NewDocument> second_half(batch.begin() + batch.size() / 2, batch.end());
+    for (const auto& document : first_half) {
+        bulk.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    start = chrono::steady_clock::now();
+    bulk.AddDocuments(second_half);
+    std::cerr << "AddDocuments: "s << documents_per_second((chrono::steady_clock::now() - start) * 2) << " docs/s"s << std::endl;
+
+    ASSERT_EQUAL(bulk.GetDocumentCount(), one_by_one.GetDocumentCount());
+    ASSERT(equal(bulk.begin(), bulk.end(), one_by_one.begin(), one_by_one.end()));
+    for (size_t i = 0; i < batch.size(); i += 97) {
+        ASSERT(bulk.GetWordFrequencies(batch[i].id) == one_by_one.GetWordFrequencies(batch[i].id));
+    }
+    for (const string& query : GenerateQueries(generator, dictionary, 20, 5)) {
+        const auto expected = one_by_one.FindTopDocuments(query, DocumentStatus::BANNED, 20);
+        const auto actual = bulk.FindTopDocuments(query, DocumentStatus::BANNED, 20);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            ASSERT_EQUAL(actual[i].id, expected[i].id);
+            ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+            ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+        }
+    }
+
+    // некорректный пакет отвергается целиком
+    const int count = bulk.GetDocumentCount();
+    ASSERT_THROWS(bulk.AddDocuments({{-1, "cat"sv, DocumentStatus::ACTUAL, {}}}), invalid_argument);
+    ASSERT_THROWS(bulk.AddDocuments({{1, "cat"sv, DocumentStatus::ACTUAL, {}}, {1, "dog"sv, DocumentStatus::ACTUAL, {}}}), invalid_argument);
+    ASSERT_THROWS(bulk.AddDocuments({{1, "cat"sv, DocumentStatus::ACTUAL, {}}, {0, "dog"sv, DocumentStatus::ACTUAL, {}}}), invalid_argument);
+    ASSERT_THROWS(bulk.AddDocuments({{1, "cat"sv, DocumentStatus::ACTUAL, {}}, {3, "d\x12og"sv, DocumentStatus::ACTUAL, {}}}), invalid_argument);
+    ASSERT_EQUAL(bulk.GetDocumentCount(), count);
+    bulk.AddDocuments({{1, "cat"sv, DocumentStatus::ACTUAL, {}}, {3, ""sv, DocumentStatus::ACTUAL, {}}});
+    ASSERT_EQUAL(bulk.GetDocumentCount(), count + 2);
+    ASSERT_EQUAL(bulk.FindTopDocuments("cat"sv).size(), 1u);
+}
+
+void AssertSameSearchResults(const SearchServer& lhs, const SearchServer& rhs, const vector<string>& queries) {
+    ASSERT_EQUAL(lhs.GetDocumentCount(), rhs.GetDocumentCount());
+    ASSERT(equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()));
+    const auto any_document = [](int, DocumentStatus, int) {
+        return true;
+    };
+    for (const string& query : queries) {
+        for (const auto& [expected, actual] : {
+                 pair{lhs.FindTopDocuments(query, any_document, 20), rhs.FindTopDocuments(query, any_document, 20)},
+                 pair{lhs.FindTopDocuments(execution::par, query, any_document, 20),
+                      rhs.FindTopDocuments(execution::par, query, any_document, 20)}}) {
+            ASSERT_EQUAL(actual.size(), expected.size());
+            for (size_t i = 0; i < actual.size(); ++i) {
+                ASSERT_EQUAL(actual[i].id, expected[i].id);
+                ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+                ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+            }
+        }
+    }
+    for (auto it = lhs.begin(); it != lhs.end(); advance(it, min<ptrdiff_t>(37, distance(it, lhs.end())))) {
+        ASSERT(lhs.GetWordFrequencies(*it) == rhs.GetWordFrequencies(*it));
+        ASSERT(lhs.MatchDocument(queries[0], *it) == rhs.MatchDocument(queries[0], *it));
+    }
+}
+
+// Тест проверяет, что все реализации разбиения на слова совпадают с простым
+// разбором и одинаково находят управляющие символы; печатает скорость каждой
+void TestTokenizer() {
+    vector<TokenizerPath> paths;
+    for (const TokenizerPath path : {TokenizerPath::SCALAR, TokenizerPath::SSE2, TokenizerPath::AVX2}) {
+        if (IsTokenizerPathSupported(path)) {
+            paths.push_back(path);
+        }
+    }
+    auto reference = [](const string& text) {
+        vector<string_view> words;
+        istringstream input(text);
+        string word;
+        size_t pos = 0;
+        while (input >> word) {
+            pos = text.find(word, pos);
+            words.push_back(string_view(text).substr(pos, word.size()));
+            pos += word.size();
+        }
+        return words;
+    };
+
+    mt19937 generator;
+    // пробелы сериями, чтобы слова и промежутки пересекали границы блоков
+    const string alphabet = "    abcdefgh\xd0\xb9\x7f"s;
+    for (int i = 0; i < 2'000; ++i) {
+        string text(uniform_int_distribution<size_t>(0, 300)(generator), ' ');
+        for (char& c : text) {
+            c = alphabet[uniform_int_distribution<size_t>(0, alphabet.size() - 1)(generator)];
+        }
+        const bool has_control = i % 4 == 0 && !text.empty();
+        if (has_control) {
+            text[uniform_int_distribution<size_t>(0, text.size() - 1)(generator)] = static_cast<char>(i % 32);
+        }
+        vector<string_view> expected;
+        SplitIntoWords(text, expected, TokenizerPath::SCALAR);
+        for (const TokenizerPath path : paths) {
+            vector<string_view> words = {"prefix"sv};
+            ASSERT_EQUAL(SplitIntoWords(text, words, path), !has_control);
+            ASSERT_EQUAL(words.size(), expected.size() + 1);
+            ASSERT(equal(expected.begin(), expected.end(), words.begin() + 1, [](string_view a, string_view b) {
+                return a.data() == b.data() && a.size() == b.size();
+            }));
+        }
+        if (!has_control) {
+            ASSERT(expected == reference(text));
+        }
+    }
+    try {
+        SearchServer("a"s).AddDocument(0, "cat\x05"s + "dog"s, DocumentStatus::ACTUAL, {});
+        ASSERT(false);
+    } catch (const invalid_argument& e) {
+        ASSERT_EQUAL(string(e.what()), "Word cat\x05"s + "dog is invalid"s);
+    }
+
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    string text;
+    while (text.size() < (64 << 20)) {
+        text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+        text += ' ';
+    }
+    vector<string_view> words;
+    words.reserve(text.size() / 2);
+    for (const TokenizerPath path : paths) {
+        size_t word_count = 0;
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < 4; ++i) {
+            words.clear();
+            ASSERT(SplitIntoWords(text, words, path));
+            word_count = words.size();
+        }
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        static const char* names[] = {"scalar", "SSE2", "AVX2"};
+        std::cerr << "Tokenizer "s << names[static_cast<int>(path)] << ": "s
+                  << 4.0 * text.size() / elapsed.count() / 1e9 << " GB/s, "s << word_count << " words"s << std::endl;
+    }
+}
+
+// Тест проверяет, что разбор запроса после прогрева не выделяет памяти:
+// MatchDocument выделяет только вектор результата, а число выделений
+// в FindTopDocuments не зависит от длины запроса
+void TestQueryParsingAllocations() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 8);
+    SearchServer search_server("and with"s);
+    for (int id = 0; id < 200; ++id) {
+        search_server.AddDocument(id, GenerateQuery(generator, dictionary, 20) + " common"s, DocumentStatus::ACTUAL, {id});
+    }
+    search_server.AddDocument(1000, "cat dog"s, DocumentStatus::ACTUAL, {});
+    // длинный запрос с повторами, стоп-словами, неизвестными словами и минус-словами
+    string long_query = GenerateQuery(generator, dictionary, 30) + " common common and unknownword -parrot -dog"s;
+    const string short_query = "common"s;
+
+    for (int i = 0; i < 3; ++i) {
+        search_server.MatchDocument(long_query, 0);
+        search_server.FindTopDocuments(long_query);
+        search_server.FindTopDocuments(short_query);
+    }
+    // проверки внутри подсчёта не годятся: макросы ASSERT сами выделяют память
+    vector<string_view> words;
+    ASSERT_EQUAL(CountAllocations([&] {
+        words = get<0>(search_server.MatchDocument(long_query, 1000));
+    }), 0u);
+    ASSERT(words.empty());
+    ASSERT_EQUAL(CountAllocations([&] {
+        words = get<0>(search_server.MatchDocument(execution::par, long_query, 1000));
+    }), 0u);
+    ASSERT(words.empty());
+    ASSERT_EQUAL(CountAllocations([&] {
+        words = get<0>(search_server.MatchDocument(long_query, 0));
+    }), 1u);
+    ASSERT(!words.empty());
+    // после прогрева запрос выделяет память только под вектор выдачи: разбор идёт
+    // в буферы потока, подсчёт — в его накопитель и рабочие массивы WAND
+    const size_t find_top_documents_budget = 1;
+    vector<Document> documents;
+    for (const RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::BLOCK_MAX_WAND}) {
+        search_server.SetRetrievalMode(mode);
+        search_server.FindTopDocuments(long_query);
+        ASSERT_EQUAL(CountAllocations([&] {
+            documents = search_server.FindTopDocuments(long_query);
+        }), find_top_documents_budget);
+        ASSERT_EQUAL(documents.size(), 5u);
+        ASSERT_EQUAL(CountAllocations([&] {
+            documents = search_server.FindTopDocuments(short_query);
+        }), find_top_documents_budget);
+        ASSERT_EQUAL(documents.size(), 5u);
+    }
+
+    // вложенный запрос из предиката получает свои буферы и не портит внешний
+    const auto expected = search_server.FindTopDocuments(long_query);
+    const auto nested = search_server.FindTopDocuments(long_query, [&](int document_id, DocumentStatus, int) {
+        return !search_server.FindTopDocuments("cat"s).empty() && document_id >= 0;
+    });
+    ASSERT_EQUAL(nested.size(), expected.size());
+    for (size_t i = 0; i < nested.size(); ++i) {
+        ASSERT_EQUAL(nested[i].id, expected[i].id);
+    }
+    ASSERT_THROWS(search_server.FindTopDocuments("cat \x01"s), invalid_argument);
+    ASSERT_THROWS(search_server.MatchDocument("cat --dog"s, 1000), invalid_argument);
+}
+
+// Тест проверяет, что RemoveDocuments даёт ту же выдачу, что и удаление по одному,
+// но переписывает заросший сегмент один раз и пишет в журнал одну запись
+void TestRemoveDocuments() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 3'000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 20, 3);
+    const auto directory = filesystem::temp_directory_path();
+    const string checkpoint_path = (directory / "search_server_batch_remove.checkpoint"s).string();
+    const string wal_path = (directory / "search_server_batch_remove.wal"s).string();
+    filesystem::remove(checkpoint_path);
+    filesystem::remove(wal_path);
+
+    SearchServer one_by_one(dictionary[0]);
+    auto batch = SearchServer::Recover(dictionary[0], checkpoint_path, wal_path);
+    for (SearchServer* server : {&one_by_one, batch.get()}) {
+        server->SetSegmentOptions({1'000, 4, false, 0.3});
+        for (size_t i = 0; i < texts.size(); ++i) {
+            server->AddDocument(i, texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)});
+        }
+    }
+    // несуществующие и повторные id пропускаются
+    vector<int> removed = {5'000, 2, 2};
+    for (int id = 0; id < 1'000; id += 2) {
+        removed.push_back(id);
+        one_by_one.RemoveDocument(id);
+    }
+    batch->RemoveDocuments(removed);
+    batch->RemoveDocuments({});
+    AssertSameSearchResults(one_by_one, *batch, queries);
+    const auto stats = batch->GetDeletionStats();
+    ASSERT_EQUAL(stats.live_documents, 2'500u);
+    ASSERT_EQUAL(stats.compactions, 1u);
+    ASSERT_EQUAL(stats.tombstones, 0u);
+
+    batch->SyncWal();
+    size_t record_count = 0;
+    WriteAheadLog::Replay(wal_path, [&record_count](uint64_t, uint32_t, string_view) {
+        ++record_count;
+    });
+    ASSERT_EQUAL(record_count, texts.size() + 1);
+    batch.reset();
+    AssertSameSearchResults(one_by_one, *SearchServer::Recover(dictionary[0], checkpoint_path, wal_path), queries);
+    filesystem::remove(checkpoint_path);
+    filesystem::remove(wal_path);
+}
+
+// Тест проверяет, что RemoveDuplicates удаляет документы с тем же множеством слов,
+// что у документа с меньшим id, независимо от порядка, повторов и стоп-слов
+void TestRemoveDuplicates() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(10, "and with"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(11, "with"s, DocumentStatus::ACTUAL, {1, 2});
+    ASSERT(search_server.HasSameTerms(6, 7));
+    ASSERT(!search_server.HasSameTerms(1, 8));
+    ASSERT_EQUAL(search_server.GetTermSetFingerprint(1), search_server.GetTermSetFingerprint(5));
+    ASSERT(search_server.GetTermSetFingerprint(1) != search_server.GetTermSetFingerprint(8));
+    ASSERT_THROWS(search_server.GetTermSetFingerprint(100), out_of_range);
+
+    ostringstream output;
+    auto* const old_buffer = cout.rdbuf(output.rdbuf());
+    RemoveDuplicates(search_server);
+    cout.rdbuf(old_buffer);
+    ASSERT_EQUAL(output.str(), "Found duplicate document id 3\n"s
+                               "Found duplicate document id 4\n"s
+                               "Found duplicate document id 5\n"s
+                               "Found duplicate document id 7\n"s
+                               "Found duplicate document id 11\n"s);
+    ASSERT(vector<int>(search_server.begin(), search_server.end()) == (vector<int>{1, 2, 6, 8, 9, 10}));
+
+    // тексты повторяются с переставленными словами; ответ сверяется с наивным подсчётом
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 100'000, 8);
+    vector<string> document_texts;
+    set<set<string_view>> distinct_word_sets;
+    for (int i = 0; i < 300'000; ++i) {
+        const string& text = texts[uniform_int_distribution<size_t>(0, texts.size() - 1)(generator)];
+        auto words = SplitIntoWords(text);
+        shuffle(words.begin(), words.end(), generator);
+        string shuffled;
+        for (const string_view word : words) {
+            shuffled += word;
+            shuffled += ' ';
+        }
+        document_texts.push_back(move(shuffled));
+        distinct_word_sets.insert(set<string_view>(words.begin(), words.end()));
+    }
+    vector<SearchServer::NewDocument> documents;
+    for (size_t i = 0; i < document_texts.size(); ++i) {
+        documents.push_back({static_cast<int>(i), document_texts[i], DocumentStatus::ACTUAL, {1}});
+    }
+    SearchServer big_server(""s);
+    big_server.AddDocuments(documents);
+    cout.rdbuf(output.rdbuf());
+    {
+        LOG_DURATION("RemoveDuplicates, 300000 documents"s);
+        RemoveDuplicates(big_server);
+    }
+    cout.rdbuf(old_buffer);
+    ASSERT_EQUAL(static_cast<size_t>(big_server.GetDocumentCount()), distinct_word_sets.size());
+}
+
+// Тест проверяет поиск почти-дубликатов: точное сходство найденных пар, поддержку
+// индекса при удалении, отбраковку при вставке; на синтетическом корпусе сверяет
+// выдачу с полным перебором пар и печатает полноту и точность
+void TestNearDuplicates() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "a b c d e f g h i j"s, DocumentStatus::ACTUAL, {1});
+    // 9 общих слов из 11
+    search_server.AddDocument(2, "a b c d e f g h i k"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(3, "j i h g f e d c b a and a"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(4, "a b c d e x y z u v"s, DocumentStatus::ACTUAL, {1});
+    auto near_duplicates = search_server.FindNearDuplicates(0.8);
+    ASSERT_EQUAL(near_duplicates.size(), 3u);
+    ASSERT_EQUAL(near_duplicates[0].document_id, 2);
+    ASSERT_EQUAL(near_duplicates[0].original_id, 1);
+    ASSERT(abs(near_duplicates[0].similarity - 9.0 / 11) < ACCURACY);
+    ASSERT_EQUAL(near_duplicates[1].document_id, 3);
+    ASSERT_EQUAL(near_duplicates[1].original_id, 1);
+    ASSERT_EQUAL(near_duplicates[1].similarity, 1.0);
+    ASSERT_EQUAL(near_duplicates[2].document_id, 3);
+    ASSERT_EQUAL(near_duplicates[2].original_id, 2);
+    ASSERT_EQUAL(search_server.FindNearDuplicates(0.9).size(), 1u);
+
+    ASSERT_THROWS(search_server.EnableNearDuplicateIndex({100, 32}), invalid_argument);
+    search_server.EnableNearDuplicateIndex({64, 16, true, 0.8});
+    search_server.RemoveDocument(1);
+    near_duplicates = search_server.FindNearDuplicates(0.8);
+    ASSERT_EQUAL(near_duplicates.size(), 1u);
+    ASSERT_EQUAL(near_duplicates[0].document_id, 3);
+    // отличается от документа 2 одним словом из десяти
+    search_server.AddDocument(5, "a b c d e f g h i k l"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(search_server.GetRejectedNearDuplicateCount(), 1u);
+    ASSERT_THROWS(search_server.MatchDocument("a"s, 5), out_of_range);
+    search_server.AddDocuments({{6, "p q r s t"s, DocumentStatus::ACTUAL, {1}},
+                                {7, "p q r s t and"s, DocumentStatus::ACTUAL, {1}},
+                                {8, "new words only"s, DocumentStatus::ACTUAL, {1}}});
+    ASSERT_EQUAL(search_server.GetRejectedNearDuplicateCount(), 2u);
+    ASSERT(vector<int>(search_server.begin(), search_server.end()) == (vector<int>{2, 3, 4, 6, 8}));
+    const auto clone = search_server.Clone();
+    ASSERT_EQUAL(clone->FindNearDuplicates(0.8).size(), 1u);
+    search_server.DisableNearDuplicateIndex();
+    search_server.AddDocument(5, "a b c d e f g h i k l"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 6);
+
+    // базовые документы из случайных слов и их копии с заменой от 1 до 8 слов из 30
+    mt19937 generator;
+    // GenerateDictionary убирает только соседние повторы, а здесь слова должны быть различны
+    auto dictionary = GenerateDictionary(generator, 5'000, 10);
+    sort(dictionary.begin(), dictionary.end());
+    dictionary.erase(unique(dictionary.begin(), dictionary.end()), dictionary.end());
+    const int base_count = 3'000;
+    const int variant_count = 1'000;
+    vector<vector<int>> word_sets;
+    auto random_word = [&] {
+        return uniform_int_distribution<int>(0, static_cast<int>(dictionary.size()) - 1)(generator);
+    };
+    for (int i = 0; i < base_count; ++i) {
+        set<int> words;
+        while (words.size() < 30) {
+            words.insert(random_word());
+        }
+        word_sets.emplace_back(words.begin(), words.end());
+    }
+    for (int i = 0; i < variant_count; ++i) {
+        vector<int> words = word_sets[uniform_int_distribution<int>(0, base_count - 1)(generator)];
+        shuffle(words.begin(), words.end(), generator);
+        const int replaced = uniform_int_distribution<int>(1, 8)(generator);
+        for (int j = 0; j < replaced; ++j) {
+            int word = random_word();
+            while (find(words.begin(), words.end(), word) != words.end()) {
+                word = random_word();
+            }
+            words[j] = word;
+        }
+        sort(words.begin(), words.end());
+        word_sets.push_back(move(words));
+    }
+    vector<string> texts;
+    for (const auto& words : word_sets) {
+        string text;
+        for (const int word : words) {
+            text += dictionary[word] + ' ';
+        }
+        texts.push_back(move(text));
+    }
+    SearchServer corpus(""s);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        corpus.AddDocument(static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1});
+    }
+
+    // сходство всех пар из не меньше чем половины общих слов, полным перебором
+    map<pair<int, int>, double> similar_pairs;
+    for (size_t i = 0; i < word_sets.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            vector<int> common;
+            set_intersection(word_sets[i].begin(), word_sets[i].end(), word_sets[j].begin(), word_sets[j].end(),
+                             back_inserter(common));
+            const double similarity = static_cast<double>(common.size()) / (word_sets[i].size() + word_sets[j].size() - common.size());
+            if (similarity >= 0.5) {
+                similar_pairs[{static_cast<int>(i), static_cast<int>(j)}] = similarity;
+            }
+        }
+    }
+    // у порога 0.5 полосы по 4 строки теряют часть пар, поэтому полнота там только печатается
+    vector<SearchServer::NearDuplicate> found;
+    for (const double threshold : {0.5, 0.7}) {
+        size_t expected = 0;
+        for (const auto& [pair, similarity] : similar_pairs) {
+            expected += similarity >= threshold;
+        }
+        {
+            LOG_DURATION("FindNearDuplicates, 4000 documents"s);
+            found = corpus.FindNearDuplicates(threshold);
+        }
+        size_t true_positives = 0;
+        for (const auto& pair : found) {
+            const auto it = similar_pairs.find({pair.document_id, pair.original_id});
+            true_positives += it != similar_pairs.end() && it->second >= threshold;
+        }
+        const double recall = static_cast<double>(true_positives) / expected;
+        const double precision = found.empty() ? 1.0 : static_cast<double>(true_positives) / found.size();
+        std::cerr << "Near duplicates at "s << threshold << ": "s << expected << " expected, "s << found.size()
+                  << " found, recall "s << recall << ", precision "s << precision << std::endl;
+        ASSERT(expected > 500);
+        ASSERT_EQUAL(precision, 1.0);
+        if (threshold >= 0.7) {
+            ASSERT(recall > 0.98);
+        }
+    }
+
+    // 32 полосы по 2 строки ловят и пары со сходством около 0.4, но дают больше ложных кандидатов
+    corpus.EnableNearDuplicateIndex({64, 32});
+    ASSERT_EQUAL(corpus.FindNearDuplicates(0.7).size(), found.size());
+}
+
+// Тест проверяет, что разбиение индекса на сегменты, их слияние и удаление через
+// отметки дают ту же выдачу, что и индекс из одного сегмента, а слияние
+// выбрасывает записи удалённых документов
+void TestSegments() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 3'000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 20, 3);
+    SearchServer reference(dictionary[0]);
+    reference.SetSegmentOptions({texts.size() * 2, 2, false});
+    SearchServer segmented(dictionary[0]);
+    segmented.SetSegmentOptions({100, 3, true});
+    ASSERT_THROWS(segmented.SetSegmentOptions({100, 1, true}), invalid_argument);
+    for (SearchServer* server : {&reference, &segmented}) {
+        for (size_t i = 0; i < texts.size(); ++i) {
+            server->AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 4), {static_cast<int>(i % 10)});
+            if (i % 5 == 4) {
+                server->RemoveDocument(i - 2);
+            }
+        }
+    }
+    ASSERT_EQUAL(reference.GetSegmentCount(), 1u);
+    ASSERT(segmented.GetSegmentCount() > 1);
+
+    auto assert_same_results = [&] {
+        for (const RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::BLOCK_MAX_WAND}) {
+            reference.SetRetrievalMode(mode);
+            segmented.SetRetrievalMode(mode);
+            AssertSameSearchResults(reference, segmented, queries);
+        }
+    };
+    assert_same_results();
+    segmented.WaitForMerges();
+    // 30 запечатанных сегментов по 100 документов сливаются ярусами по 3
+    ASSERT(segmented.GetSegmentCount() < 10);
+    assert_same_results();
+
+    reference.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+    segmented.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+    reference.ResetRetrievalStats();
+    segmented.ResetRetrievalStats();
+    for (const string& query : queries) {
+        reference.FindTopDocuments(query);
+        segmented.FindTopDocuments(query);
+    }
+    const auto reference_stats = reference.GetRetrievalStats();
+    const auto segmented_stats = segmented.GetRetrievalStats();
+    ASSERT(segmented_stats.postings_scored + segmented_stats.postings_skipped
+           < reference_stats.postings_scored + reference_stats.postings_skipped);
+
+    // пакет и удаления после слияний, в том числе всех документов с одним словом
+    vector<SearchServer::NewDocument> batch;
+    for (size_t i = 0; i < 250; ++i) {
+        batch.push_back({static_cast<int>(10'000 + i), texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 7)}});
+    }
+    batch.push_back({20'000, "unique"sv, DocumentStatus::ACTUAL, {1}});
+    for (SearchServer* server : {&reference, &segmented}) {
+        server->AddDocuments(batch);
+        for (int id = 0; id < 3'000; id += 11) {
+            server->RemoveDocument(id);
+        }
+        server->RemoveDocument(20'000);
+    }
+    segmented.WaitForMerges();
+    ASSERT(segmented.FindTopDocuments("unique"s).empty());
+    assert_same_results();
+}
+
+// Тест проверяет, что сервер, загруженный из снимка, можно уничтожить, пока фоновое
+// слияние ещё читает списки вхождений из отображения снимка
+void TestMergeOfLoadedSegments() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 60'000, 20);
+    const string path = (filesystem::temp_directory_path() / "search_server_merge_test.snapshot"s).string();
+    {
+        SearchServer search_server(dictionary[0]);
+        search_server.SetSegmentOptions({20'000, 4, false});
+        for (size_t i = 0; i < texts.size(); ++i) {
+            search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1});
+        }
+        search_server.SaveSnapshot(path);
+    }
+    for (int round = 0; round < 3; ++round) {
+        const auto loaded = SearchServer::LoadSnapshot(path);
+        ASSERT_EQUAL(loaded->GetSegmentCount(), 3u);
+        loaded->SetSegmentOptions({20'000, 4, true});
+        // четвёртый запечатанный сегмент запускает фоновое слияние трёх отображённых
+        for (int i = 0; i < 20'000; ++i) {
+            loaded->AddDocument(100'000 + i, texts[i], DocumentStatus::ACTUAL, {1});
+        }
+    }
+    filesystem::remove(path);
+}
+
+// Тест проверяет, что запечатанный сегмент, заросший удалёнными записями,
+// переписывается без них, выдача при этом не меняется, а счётчики это отражают
+void TestTombstoneCompaction() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 300, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 3'000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 20, 3);
+    SearchServer reference(dictionary[0]);
+    reference.SetSegmentOptions({texts.size() * 2, 4, false, 1.0});
+    SearchServer compacted(dictionary[0]);
+    ASSERT_THROWS(compacted.SetSegmentOptions({1'000, 4, false, -0.1}), invalid_argument);
+    compacted.SetSegmentOptions({1'000, 4, false, 0.3});
+    for (SearchServer* server : {&reference, &compacted}) {
+        for (size_t i = 0; i < texts.size(); ++i) {
+            server->AddDocument(i, texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)});
+        }
+    }
+    ASSERT_EQUAL(compacted.GetSegmentCount(), 3u);
+
+    // удаляем половину первого сегмента: переписывается, как только удалённых больше 30%
+    {
+        LOG_DURATION("RemoveDocument, 500 documents with compaction"s);
+        for (int id = 0; id < 1'000; id += 2) {
+            compacted.RemoveDocument(id);
+        }
+    }
+    for (int id = 0; id < 1'000; id += 2) {
+        reference.RemoveDocument(id);
+    }
+    auto stats = compacted.GetDeletionStats();
+    ASSERT(stats.compactions >= 1);
+    ASSERT_EQUAL(stats.merges, 0u);
+    ASSERT_EQUAL(stats.live_documents, 2'500u);
+    ASSERT(stats.GetTombstoneRatio() <= 0.3);
+    ASSERT_EQUAL(compacted.GetSegmentCount(), 3u);
+    // без порога записи удалённых остаются до слияния
+    const auto reference_stats = reference.GetDeletionStats();
+    ASSERT_EQUAL(reference_stats.tombstones, 500u);
+    ASSERT_EQUAL(reference_stats.compactions, 0u);
+    ASSERT(abs(reference_stats.GetTombstoneRatio() - 500.0 / 3'000) < ACCURACY);
+    std::cerr << "Tombstones after deleting 500 of 1000: "s << stats.tombstones << ", compactions: "s
+              << stats.compactions << std::endl;
+    for (const RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::BLOCK_MAX_WAND}) {
+        reference.SetRetrievalMode(mode);
+        compacted.SetRetrievalMode(mode);
+        AssertSameSearchResults(reference, compacted, queries);
+    }
+
+    // снимок помнит, какие удалённые документы уже выброшены из списков,
+    // поэтому после загрузки их записи не считаются заново и не вызывают лишнего переписывания
+    {
+        const string path = (filesystem::temp_directory_path() / "search_server_tombstone_test.snapshot"s).string();
+        compacted.SaveSnapshot(path);
+        const auto loaded = SearchServer::LoadSnapshot(path);
+        auto assert_same_deletion_stats = [](const SearchServer& lhs, const SearchServer& rhs) {
+            ASSERT_EQUAL(lhs.GetDeletionStats().live_documents, rhs.GetDeletionStats().live_documents);
+            ASSERT_EQUAL(lhs.GetDeletionStats().tombstones, rhs.GetDeletionStats().tombstones);
+        };
+        assert_same_deletion_stats(*loaded, compacted);
+        const uint64_t compactions = compacted.GetDeletionStats().compactions;
+        loaded->RemoveDocument(1);
+        compacted.RemoveDocument(1);
+        reference.RemoveDocument(1);
+        assert_same_deletion_stats(*loaded, compacted);
+        ASSERT_EQUAL(compacted.GetDeletionStats().compactions, compactions);
+        ASSERT_EQUAL(loaded->GetDeletionStats().compactions, 0u);
+        AssertSameSearchResults(compacted, *loaded, queries);
+        filesystem::remove(path);
+    }
+
+    // переписанный сегмент не считается заросшим заново, а фоновое переписывание
+    // подставляется в WaitForMerges
+    compacted.SetSegmentOptions({1'000, 4, true, 0.3});
+    for (int id = 1'000; id < 2'000; id += 3) {
+        compacted.RemoveDocument(id);
+        reference.RemoveDocument(id);
+    }
+    compacted.WaitForMerges();
+    stats = compacted.GetDeletionStats();
+    ASSERT(stats.compactions >= 2);
+    ASSERT(stats.GetTombstoneRatio() <= 0.3);
+    AssertSameSearchResults(reference, compacted, queries);
+}
+
+// Тест проверяет, что поиск со статусом, который идёт по битовым картам статусов,
+// совпадает с поиском с равносильным предикатом, в том числе после удалений,
+// слияний и загрузки снимка; сравнивает их скорость, когда нужный статус редок
+void TestStatusFilter() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 20'000, 30);
+    const auto queries = GenerateQueries(generator, dictionary, 200, 5);
+    SearchServer search_server(dictionary[0]);
+    search_server.SetSegmentOptions({1'000, 4, false});
+    ASSERT_THROWS(search_server.AddDocument(0, "cat"s, static_cast<DocumentStatus>(7), {}), invalid_argument);
+    // ACTUAL — каждый двадцатый документ, а первые 4000 целиком BANNED
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const DocumentStatus status = i % 20 == 0 && i >= 4'000 ? DocumentStatus::ACTUAL
+                                      : i < 4'000             ? DocumentStatus::BANNED
+                                                              : static_cast<DocumentStatus>(1 + i % 3);
+        search_server.AddDocument(i, texts[i], status, {static_cast<int>(i % 10)});
+    }
+    for (int id = 0; id < 20'000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+
+    auto assert_same_as_predicate = [&queries](SearchServer& server) {
+        for (const RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::BLOCK_MAX_WAND}) {
+            server.SetRetrievalMode(mode);
+            for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED,
+                                                DocumentStatus::REMOVED}) {
+                const auto predicate = [status](int, DocumentStatus document_status, int) {
+                    return document_status == status;
+                };
+                for (const string& query : queries) {
+                    const auto expected = server.FindTopDocuments(query, predicate);
+                    for (const auto& actual : {server.FindTopDocuments(query, status),
+                                               server.FindTopDocuments(execution::par, query, status)}) {
+                        ASSERT_EQUAL(actual.size(), expected.size());
+                        for (size_t i = 0; i < actual.size(); ++i) {
+                            ASSERT_EQUAL(actual[i].id, expected[i].id);
+                            ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+                        }
+                    }
+                }
+            }
+        }
+    };
+    assert_same_as_predicate(search_server);
+
+    const auto actual_predicate = [](int, DocumentStatus document_status, int) {
+        return document_status == DocumentStatus::ACTUAL;
+    };
+    search_server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+    {
+        LOG_DURATION("Rare status, predicate"s);
+        for (int i = 0; i < 5; ++i) {
+            for (const string& query : queries) {
+                search_server.FindTopDocuments(query, actual_predicate);
+            }
+        }
+    }
+    {
+        LOG_DURATION("Rare status, status bitmaps"s);
+        for (int i = 0; i < 5; ++i) {
+            for (const string& query : queries) {
+                search_server.FindTopDocuments(query, DocumentStatus::ACTUAL);
+            }
+        }
+    }
+
+    const string path = (filesystem::temp_directory_path() / "search_server_status_test.snapshot"s).string();
+    search_server.SaveSnapshot(path);
+    const auto loaded = SearchServer::LoadSnapshot(path);
+    assert_same_as_predicate(*loaded);
+    auto has_document = [](const vector<Document>& documents, int document_id) {
+        return any_of(documents.begin(), documents.end(), [document_id](const Document& document) {
+            return document.id == document_id;
+        });
+    };
+    ASSERT(has_document(loaded->FindTopDocuments(texts[19'980], DocumentStatus::ACTUAL), 19'980));
+    loaded->RemoveDocument(19'980);
+    ASSERT(!has_document(loaded->FindTopDocuments(texts[19'980], DocumentStatus::ACTUAL), 19'980));
+    filesystem::remove(path);
+}
+
+// Тест проверяет, что карта диапазона столбца совпадает с проверкой каждого значения,
+// а выдача с DocumentFilter — с выдачей с тем же условием в предикате, в том числе
+// после удалений и загрузки снимка; печатает время узкого фильтра по рейтингу
+void TestDocumentFilter() {
+    mt19937 generator;
+    {
+        NumericColumn column;
+        uniform_int_distribution<int> value_distribution(-1'000, 1'000);
+        for (int i = 0; i < 10'000; ++i) {
+            column.Append(i % 100 == 0 ? numeric_limits<int>::min() : value_distribution(generator));
+        }
+        vector<uint64_t> bits;
+        for (const auto& [min_value, max_value] : vector<pair<int, int>>{{-1'000, 1'000}, {0, 0}, {10, 20}, {-200, 600},
+                                                                        {5, 4}, {numeric_limits<int>::min(), -999},
+                                                                        {1'001, numeric_limits<int>::max()}}) {
+            column.CollectRange(min_value, max_value, bits);
+            ASSERT_EQUAL(bits.size(), (column.size() + 63) / 64);
+            for (uint32_t ordinal = 0; ordinal < column.size(); ++ordinal) {
+                const bool expected = column.Get(ordinal) >= min_value && column.Get(ordinal) <= max_value;
+                ASSERT_EQUAL(((bits[ordinal / 64] >> (ordinal % 64)) & 1) == 1, expected);
+            }
+        }
+    }
+
+    const auto dictionary = GenerateDictionary(generator, 1'000, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 20'000, 30);
+    const auto queries = GenerateQueries(generator, dictionary, 200, 5);
+    SearchServer search_server(dictionary[0]);
+    search_server.SetSegmentOptions({1'000, 4, false});
+    uniform_int_distribution<int> rating_distribution(-100, 100);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 4),
+                                  {rating_distribution(generator), rating_distribution(generator)});
+    }
+    for (int id = 0; id < 20'000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+    ASSERT_THROWS(search_server.FindTopDocuments("cat"s, SearchServer::DocumentFilter{static_cast<DocumentStatus>(7)}),
+                  invalid_argument);
+
+    const vector<SearchServer::DocumentFilter> filters = {
+        {},
+        {DocumentStatus::ACTUAL},
+        {DocumentStatus::BANNED, 0, 10},
+        {nullopt, 50, numeric_limits<int>::max()},
+        {nullopt, -5, 5},
+        {DocumentStatus::IRRELEVANT, 20, 19},
+    };
+    auto assert_same_as_predicate = [&queries, &filters](SearchServer& server) {
+        for (const RetrievalMode mode : {RetrievalMode::EXHAUSTIVE, RetrievalMode::BLOCK_MAX_WAND}) {
+            server.SetRetrievalMode(mode);
+            for (const auto& filter : filters) {
+                const auto predicate = [&filter](int, DocumentStatus status, int rating) {
+                    return (!filter.status || status == *filter.status) && rating >= filter.min_rating
+                           && rating <= filter.max_rating;
+                };
+                for (const string& query : queries) {
+                    const auto expected = server.FindTopDocuments(query, predicate);
+                    for (const auto& actual : {server.FindTopDocuments(query, filter),
+                                               server.FindTopDocuments(execution::par, query, filter)}) {
+                        ASSERT_EQUAL(actual.size(), expected.size());
+                        for (size_t i = 0; i < actual.size(); ++i) {
+                            ASSERT_EQUAL(actual[i].id, expected[i].id);
+                            ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+                            ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+                        }
+                    }
+                }
+            }
+        }
+    };
+    assert_same_as_predicate(search_server);
+
+    search_server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+    const SearchServer::DocumentFilter narrow_filter{nullopt, 90, 100};
+    {
+        LOG_DURATION("Narrow rating range, predicate"s);
+        for (int i = 0; i < 5; ++i) {
+            for (const string& query : queries) {
+                search_server.FindTopDocuments(query, [](int, DocumentStatus, int rating) {
+                    return rating >= 90 && rating <= 100;
+                });
+            }
+        }
+    }
+    {
+        LOG_DURATION("Narrow rating range, filter bitmap"s);
+        for (int i = 0; i < 5; ++i) {
+            for (const string& query : queries) {
+                search_server.FindTopDocuments(query, narrow_filter);
+            }
+        }
+    }
+
+    const string path = (filesystem::temp_directory_path() / "search_server_filter_test.snapshot"s).string();
+    search_server.SaveSnapshot(path);
+    const auto loaded = SearchServer::LoadSnapshot(path);
+    assert_same_as_predicate(*loaded);
+    filesystem::remove(path);
+}
+
+// Тест проверяет ParallelFor пула (в том числе вложенный и с исключением) и то, что
+// ProcessQueries на пуле сервера даёт ту же выдачу; печатает пропускную способность
+// пакета запросов для разного числа потоков
+void TestThreadPool() {
+    {
+        ThreadPool pool(3);
+        ASSERT_EQUAL(pool.GetThreadCount(), 3u);
+        vector<atomic<int>> visits(1'000);
+        pool.ParallelFor(visits.size(), [&](size_t i) {
+            pool.ParallelFor(10, [&](size_t) {
+                ++visits[i];
+            });
+        });
+        ASSERT(all_of(visits.begin(), visits.end(), [](const atomic<int>& count) {
+            return count == 10;
+        }));
+        ASSERT_THROWS(pool.ParallelFor(100, [](size_t i) {
+            if (i == 42) {
+                throw invalid_argument("42"s);
+            }
+        }), invalid_argument);
+        bool called = false;
+        pool.ParallelFor(0, [&called](size_t) {
+            called = true;
+        });
+        ASSERT(!called);
+    }
+
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 2'000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 20'000, 50);
+    const auto queries = GenerateQueries(generator, dictionary, 2'000, 7);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)});
+    }
+    const auto expected = ProcessQueries(execution::seq, search_server, queries);
+    auto same_results = [&expected](const vector<vector<Document>>& results) {
+        return equal(results.begin(), results.end(), expected.begin(), expected.end(),
+                     [](const vector<Document>& lhs, const vector<Document>& rhs) {
+                         return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+                             return l.id == r.id && l.relevance == r.relevance && l.rating == r.rating;
+                         });
+                     });
+    };
+    ASSERT(same_results(ProcessQueries(execution::par, search_server, queries)));
+    ASSERT(same_results(ProcessQueries(search_server, queries)));
+
+    const size_t hardware_threads = max(1u, thread::hardware_concurrency());
+    for (const size_t thread_count : {size_t(1), size_t(2), size_t(4), hardware_threads}) {
+        search_server.SetThreadPool(make_shared<ThreadPool>(thread_count));
+        const auto start = chrono::steady_clock::now();
+        const auto results = ProcessQueries(execution::par, search_server, queries);
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        ASSERT(same_results(results));
+        std::cerr << "ProcessQueries on "s << thread_count << " threads: "s
+                  << static_cast<int64_t>(queries.size() / max(seconds, 1e-9)) << " queries/s"s << std::endl;
+    }
+    ASSERT(same_results(ProcessQueries(search_server, queries)));
+    ASSERT_THROWS(ProcessQueries(execution::par, search_server, {"cat --dog"s}), invalid_argument);
+    search_server.SetThreadPool(nullptr);
+}
+
+// Тест проверяет, что асинхронные запросы дают ту же выдачу, что и синхронные,
+// передают ошибки через future и callback, и что один поток держит в работе тысячи запросов
+void TestAsyncQueries() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 5'000, 30);
+    const auto queries = GenerateQueries(generator, dictionary, 2'000, 4);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 2), {static_cast<int>(i % 10)});
+    }
+    search_server.SetThreadPool(make_shared<ThreadPool>(2));
+    auto same_documents = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+            return l.id == r.id && l.relevance == r.relevance && l.rating == r.rating;
+        });
+    };
+
+    vector<future<vector<Document>>> futures;
+    {
+        LOG_DURATION("FindTopDocumentsAsync, 2000 queries in flight"s);
+        for (const string& query : queries) {
+            futures.push_back(search_server.FindTopDocumentsAsync(query, DocumentStatus::BANNED, 10));
+        }
+        for (size_t i = 0; i < queries.size(); ++i) {
+            ASSERT(same_documents(futures[i].get(), search_server.FindTopDocuments(queries[i], DocumentStatus::BANNED, 10)));
+        }
+    }
+    ASSERT_THROWS(search_server.FindTopDocumentsAsync("cat --dog"s).get(), invalid_argument);
+
+    promise<void> all_done;
+    atomic<size_t> remaining = queries.size();
+    atomic<size_t> mismatches = 0;
+    for (const string& query : queries) {
+        search_server.FindTopDocumentsAsync(query, DocumentStatus::ACTUAL, 5,
+                                            [&, query](vector<Document> documents, exception_ptr error) {
+                                                if (error || !same_documents(documents, search_server.FindTopDocuments(query))) {
+                                                    ++mismatches;
+                                                }
+                                                if (--remaining == 0) {
+                                                    all_done.set_value();
+                                                }
+                                            });
+    }
+    all_done.get_future().wait();
+    ASSERT_EQUAL(mismatches.load(), 0u);
+
+    // исключение из callback на потоке пула завершило бы программу, поэтому проверки — после
+    promise<bool> callback_failed;
+    search_server.FindTopDocumentsAsync("-"s, DocumentStatus::ACTUAL, 5, [&](vector<Document> documents, exception_ptr error) {
+        callback_failed.set_value(documents.empty() && error != nullptr);
+    });
+    ASSERT(callback_failed.get_future().get());
+
+    const auto expected = ProcessQueries(search_server, queries);
+    const auto results = ProcessQueriesAsync(search_server, queries).get();
+    ASSERT_EQUAL(results.size(), expected.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        ASSERT(same_documents(results[i], expected[i]));
+    }
+    promise<bool> batch_failed;
+    ProcessQueriesAsync(search_server, {queries[0], "cat --dog"s},
+                        [&](vector<vector<Document>> batch, exception_ptr error) {
+                            batch_failed.set_value(batch.empty() && error != nullptr);
+                        });
+    ASSERT(batch_failed.get_future().get());
+    search_server.SetThreadPool(nullptr);
+    ASSERT_EQUAL(search_server.FindTopDocumentsAsync(queries[0]).get().size(), search_server.FindTopDocuments(queries[0]).size());
+}
+
+// Тест проверяет, что кэш выдачи не меняет результатов, нормализует запросы,
+// инвалидируется изменениями индекса и держит объём в заданных рамках;
+// сравнивает скорость повторяющихся запросов с кэшем и без
+void TestQueryCache() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 10'000, 30);
+    // популярные запросы повторяются: 50 разных на 5000 обращений
+    const auto distinct_queries = GenerateQueries(generator, dictionary, 50, 4);
+    vector<string> traffic;
+    for (int i = 0; i < 5'000; ++i) {
+        traffic.push_back(distinct_queries[uniform_int_distribution<size_t>(0, distinct_queries.size() - 1)(generator)]);
+    }
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 2), {static_cast<int>(i % 10)});
+    }
+    auto run = [&search_server, &traffic] {
+        vector<vector<Document>> results;
+        for (const string& query : traffic) {
+            results.push_back(search_server.FindTopDocuments(query));
+        }
+        return results;
+    };
+    auto same_results = [](const vector<vector<Document>>& lhs, const vector<vector<Document>>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const vector<Document>& l, const vector<Document>& r) {
+            return equal(l.begin(), l.end(), r.begin(), r.end(), [](const Document& a, const Document& b) {
+                return a.id == b.id && a.relevance == b.relevance && a.rating == b.rating;
+            });
+        });
+    };
+
+    vector<vector<Document>> expected;
+    {
+        LOG_DURATION("Skewed queries without cache"s);
+        expected = run();
+    }
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, 0u);
+    search_server.EnableQueryCache({1 << 20, 4});
+    {
+        LOG_DURATION("Skewed queries with cache"s);
+        ASSERT(same_results(run(), expected));
+    }
+    auto stats = search_server.GetQueryCacheStats();
+    std::cerr << "Query cache hit rate: "s << stats.GetHitRate() << ", "s << stats.entries << " entries, "s
+              << stats.memory_bytes << " bytes"s << std::endl;
+    ASSERT_EQUAL(stats.misses, distinct_queries.size());
+    ASSERT(stats.GetHitRate() > 0.9);
+
+    // порядок и повторы слов, незнакомые слова не меняют ключ
+    const string query = dictionary[5] + " "s + dictionary[7];
+    search_server.FindTopDocuments(query);
+    stats = search_server.GetQueryCacheStats();
+    search_server.FindTopDocuments(dictionary[7] + " "s + dictionary[5] + " "s + dictionary[7] + " nosuchword"s);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, stats.hits + 1);
+    // другие статус и top_k — другие ключи
+    search_server.FindTopDocuments(query, DocumentStatus::BANNED);
+    search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 3);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, stats.hits + 1);
+    // запрос с предикатом идёт мимо кэша
+    stats = search_server.GetQueryCacheStats();
+    search_server.FindTopDocuments(query, [](int, DocumentStatus, int) {
+        return true;
+    });
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits + search_server.GetQueryCacheStats().misses,
+                 stats.hits + stats.misses);
+
+    // изменения индекса сразу видны в выдаче
+    search_server.AddDocument(100'000, query + " "s + query, DocumentStatus::ACTUAL, {100});
+    ASSERT_EQUAL(search_server.FindTopDocuments(query).at(0).id, 100'000);
+    search_server.RemoveDocument(100'000);
+    ASSERT(search_server.FindTopDocuments(query).at(0).id != 100'000);
+    ASSERT(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL).at(0).id != 100'000);
+
+    // маленький кэш вытесняет записи, но не выходит за объём
+    search_server.EnableQueryCache({4'096, 2});
+    ASSERT(same_results(run(), expected));
+    stats = search_server.GetQueryCacheStats();
+    ASSERT(stats.memory_bytes <= 4'096);
+    ASSERT(stats.entries < distinct_queries.size());
+    search_server.DisableQueryCache();
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().entries, 0u);
+}
+
+// Тест проверяет окно RequestQueue по времени, вытеснение при заполнении буфера
+// и запись запросов из многих потоков
+void TestRequestQueue() {
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+    search_server.AddDocument(4, "big dog sparrow Eugene"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    search_server.AddDocument(5, "big dog sparrow Vasiliy"s, DocumentStatus::ACTUAL, {1, 1, 1});
+
+    // одна минута на запрос, окно — сутки
+    auto minutes = make_shared<atomic<int64_t>>(0);
+    RequestQueue request_queue(search_server, {chrono::hours(24), 4'096, [minutes] {
+        return chrono::steady_clock::time_point(chrono::minutes(minutes->load()));
+    }});
+    for (int i = 0; i < 1439; ++i) {
+        *minutes = i;
+        request_queue.AddFindRequest("empty request"sv);
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    *minutes = 1439;
+    request_queue.AddFindRequest("curly dog"sv);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    // сутки с первых запросов прошли, они выпадают из окна
+    *minutes = 1440;
+    request_queue.AddFindRequest("big collar"sv);
+    *minutes = 1441;
+    request_queue.AddFindRequest("sparrow"sv, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1437);
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 1440);
+    *minutes += 24 * 60;
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+    ASSERT_EQUAL(request_queue.GetRequestCount(), 0);
+
+    RequestQueue small_queue(search_server, {chrono::hours(1), 16, chrono::steady_clock::now});
+    for (int i = 0; i < 100; ++i) {
+        small_queue.AddFindRequest(i % 2 == 0 ? "cat"sv : "nothing"sv);
+    }
+    ASSERT_EQUAL(small_queue.GetRequestCount(), 16);
+    ASSERT_EQUAL(small_queue.GetNoResultRequests(), 8);
+
+    RequestQueue shared_queue(search_server, {chrono::hours(1), 1 << 15, chrono::steady_clock::now});
+    const int thread_count = 4;
+    const int requests_per_thread = 5'000;
+    {
+        LOG_DURATION("RequestQueue, 4 threads x 5000 requests"s);
+        vector<thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&shared_queue, t] {
+                for (int i = 0; i < requests_per_thread; ++i) {
+                    shared_queue.AddFindRequest((i + t) % 4 == 0 ? "nothing"sv : "big dog"sv, [](int, DocumentStatus, int) {
+                        return true;
+                    });
+                }
+            });
+        }
+        for (thread& worker : threads) {
+            worker.join();
+        }
+    }
+    ASSERT_EQUAL(shared_queue.GetRequestCount(), thread_count * requests_per_thread);
+    ASSERT_EQUAL(shared_queue.GetNoResultRequests(), thread_count * requests_per_thread / 4);
+}
+
+// Тест проверяет, что читатели ConcurrentSearchServer во время изменений видят
+// согласованный индекс, и сравнивает задержки чтения без писателя, с писателем
+// и с писателем под общей блокировкой shared_mutex
+void TestConcurrentSearchServer() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 500, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 6'000, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 200, 3);
+    const size_t initial_count = 4'000;
+    const int reader_count = 2;
+    const size_t reads_per_reader = 300;
+
+    vector<SearchServer::NewDocument> initial;
+    for (size_t i = 0; i < initial_count; ++i) {
+        initial.push_back({static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)}});
+    }
+    // писатель добавляет документ и удаляет самый старый, так что документов
+    // всегда initial_count или initial_count + 1
+    auto write = [&texts, initial_count](auto& server, size_t step) {
+        const size_t id = initial_count + step;
+        server.AddDocument(id, texts[id % texts.size()], DocumentStatus::ACTUAL, {static_cast<int>(id % 10)});
+        server.RemoveDocument(step);
+    };
+    auto percentile = [](vector<int64_t> latencies, size_t percent) {
+        sort(latencies.begin(), latencies.end());
+        return latencies[latencies.size() * percent / 100];
+    };
+    // читатели делают по reads_per_reader запросов, пока писатель работает; read возвращает,
+    // согласован ли индекс, который видел запрос
+    auto run = [&](auto read, auto write_step, bool with_writer, const string& name) {
+        atomic<bool> stop = false;
+        atomic<size_t> steps = 0;
+        thread writer([&] {
+            while (with_writer && !stop) {
+                write_step(steps++);
+            }
+        });
+        vector<vector<int64_t>> latencies(reader_count);
+        vector<thread> readers;
+        atomic<bool> consistent = true;
+        for (int r = 0; r < reader_count; ++r) {
+            readers.emplace_back([&, r] {
+                for (size_t i = 0; i < reads_per_reader; ++i) {
+                    const auto start = chrono::steady_clock::now();
+                    if (!read(queries[(r * reads_per_reader + i) % queries.size()], i % 10 == 0)) {
+                        consistent = false;
+                    }
+                    latencies[r].push_back(chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - start).count());
+                }
+            });
+        }
+        for (thread& reader : readers) {
+            reader.join();
+        }
+        stop = true;
+        writer.join();
+        ASSERT(consistent);
+        vector<int64_t> all;
+        for (const auto& reader_latencies : latencies) {
+            all.insert(all.end(), reader_latencies.begin(), reader_latencies.end());
+        }
+        std::cerr << name << ": p50 "s << percentile(all, 50) << " us, p99 "s << percentile(all, 99) << " us, "s
+                  << steps << " writes"s << std::endl;
+        return steps.load();
+    };
+
+    auto check = [initial_count](const SearchServer& server, const string& query, bool full_check) {
+        const auto count = static_cast<size_t>(server.GetDocumentCount());
+        if (count != initial_count && count != initial_count + 1) {
+            return false;
+        }
+        if (full_check && static_cast<size_t>(distance(server.begin(), server.end())) != count) {
+            return false;
+        }
+        for (const Document& document : server.FindTopDocuments(query)) {
+            server.MatchDocument(query, document.id);
+        }
+        return true;
+    };
+
+    ConcurrentSearchServer concurrent(dictionary[0]);
+    concurrent.AddDocuments(initial);
+    ASSERT_EQUAL(concurrent.GetVersion(), 1u);
+    auto concurrent_read = [&](const string& query, bool full_check) {
+        return concurrent.Read([&](const SearchServer& server) {
+            return check(server, query, full_check);
+        });
+    };
+    auto concurrent_write = [&](size_t step) {
+        write(concurrent, step);
+    };
+    run(concurrent_read, concurrent_write, false, "ConcurrentSearchServer, idle writer"s);
+    const size_t steps = run(concurrent_read, concurrent_write, true, "ConcurrentSearchServer, busy writer"s);
+    ASSERT_EQUAL(concurrent.GetVersion(), 1 + 2 * steps);
+
+    // итог тот же, что у последовательного сервера с теми же изменениями
+    SearchServer reference(dictionary[0]);
+    reference.AddDocuments(initial);
+    for (size_t step = 0; step < steps; ++step) {
+        write(reference, step);
+    }
+    concurrent.Read([&](const SearchServer& server) {
+        AssertSameSearchResults(reference, server, queries);
+    });
+    const auto [words, status] = concurrent.MatchDocument(queries[0], *reference.begin());
+    const auto [expected_words, expected_status] = reference.MatchDocument(queries[0], *reference.begin());
+    ASSERT(equal(words.begin(), words.end(), expected_words.begin(), expected_words.end()));
+    ASSERT_EQUAL(static_cast<int>(status), static_cast<int>(expected_status));
+
+    // writer, бросивший на середине, не оставляет своих изменений ни в одной копии:
+    // следующие изменения по очереди публикуют обе копии, и обе видят одно и то же
+    {
+        ConcurrentSearchServer failing(dictionary[0]);
+        ASSERT_THROWS(failing.Write([&texts](SearchServer& server) {
+                          server.AddDocument(1, texts[1], DocumentStatus::ACTUAL, {1});
+                          server.AddDocument(1, texts[1], DocumentStatus::ACTUAL, {1});
+                      }),
+                      invalid_argument);
+        ASSERT_EQUAL(failing.GetVersion(), 0u);
+        ASSERT_EQUAL(failing.GetDocumentCount(), 0);
+        for (int id = 1; id <= 4; ++id) {
+            failing.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {1});
+            ASSERT_EQUAL(failing.GetDocumentCount(), id);
+        }
+    }
+
+    SearchServer locked(dictionary[0]);
+    locked.AddDocuments(initial);
+    shared_mutex mutex;
+    run([&](const string& query, bool full_check) {
+            shared_lock lock(mutex);
+            return check(locked, query, full_check);
+        },
+        [&](size_t step) {
+            unique_lock lock(mutex);
+            write(locked, step);
+        },
+        true, "shared_mutex, busy writer"s);
+}
+
+// Тест проверяет, что сервер, загруженный из снимка, отвечает так же, как исходный,
+// остаётся изменяемым, а повреждённый снимок не загружается
+void TestSnapshot() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 20'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 20, 5);
+    const string stop_words = dictionary[0] + " "s + dictionary[1];
+    SearchServer search_server(stop_words);
+    {
+        LOG_DURATION("Index 20000 documents"s);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            search_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 4), {static_cast<int>(i % 10)});
+        }
+    }
+    for (int id = 0; id < 20'000; id += 13) {
+        search_server.RemoveDocument(id);
+    }
+
+    const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+    search_server.SaveSnapshot(path);
+    unique_ptr<SearchServer> loaded;
+    {
+        LOG_DURATION("LoadSnapshot 20000 documents"s);
+        loaded = SearchServer::LoadSnapshot(path);
+    }
+    AssertSameSearchResults(search_server, *loaded, queries);
+
+    // изменения после загрузки копируют затронутые списки из отображения
+    for (SearchServer* server : {&search_server, loaded.get()}) {
+        server->AddDocument(100'000, queries[0], DocumentStatus::ACTUAL, {5});
+        server->RemoveDocument(14);
+    }
+    AssertSameSearchResults(search_server, *loaded, queries);
+
+    // файл перезаписывается, пока его отображение не занято
+    loaded.reset();
+    string bytes;
+    {
+        ifstream in(path, ios::binary);
+        bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    auto corrupt = [&bytes, &path](size_t position) {
+        string corrupted = bytes;
+        corrupted[position] ^= 1;
+        ofstream out(path, ios::binary | ios::trunc);
+        out << corrupted;
+    };
+    // повреждённая таблица разделов не даёт загрузить снимок
+    corrupt(SNAPSHOT_ALIGNMENT);
+    ASSERT_THROWS(SearchServer::LoadSnapshot(path), runtime_error);
+
+    // повреждённые списки вхождений (раздел 5, его смещение — первое поле записи таблицы)
+    // не читаются при загрузке, а находятся перед первым запросом
+    uint64_t posting_data_offset = 0;
+    memcpy(&posting_data_offset, bytes.data() + SNAPSHOT_ALIGNMENT + 5 * 32, sizeof(posting_data_offset));
+    corrupt(posting_data_offset);
+    {
+        const auto damaged = SearchServer::LoadSnapshot(path);
+        ASSERT_THROWS(damaged->FindTopDocuments(queries[0]), runtime_error);
+    }
+
+    // повреждённый текст документа не мешает поиску, но находится проверкой
+    // и не переписывается в новый снимок
+    const size_t text_position = bytes.find(texts[1]);
+    ASSERT(text_position != string::npos);
+    corrupt(text_position);
+    {
+        const auto damaged = SearchServer::LoadSnapshot(path);
+        ASSERT(!damaged->FindTopDocuments(queries[0]).empty());
+        ASSERT_THROWS(damaged->VerifySnapshot(), runtime_error);
+        ASSERT_THROWS(damaged->SaveSnapshot(path + ".copy"s), runtime_error);
+    }
+
+    // любое повреждение находится не позже VerifySnapshot
+    corrupt(bytes.size() / 2);
+    ASSERT_THROWS(SearchServer::LoadSnapshot(path)->VerifySnapshot(), runtime_error);
+    filesystem::remove(path);
+    ASSERT_THROWS(SearchServer::LoadSnapshot(path), runtime_error);
+}
+
+// Тест проверяет восстановление после сбоя: контрольная точка и хвост журнала
+// дают тот же индекс, что и без сбоя, а оборванная запись в конце журнала отбрасывается
+void TestWriteAheadLog() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 200, 8);
+    const auto texts = GenerateQueries(generator, dictionary, 600, 20);
+    const auto queries = GenerateQueries(generator, dictionary, 10, 3);
+    const auto directory = filesystem::temp_directory_path();
+    const string checkpoint_path = (directory / "search_server_test.checkpoint"s).string();
+    const string wal_path = (directory / "search_server_test.wal"s).string();
+    const string old_wal_path = wal_path + ".old"s;
+    for (const string& path : {checkpoint_path, wal_path, old_wal_path}) {
+        filesystem::remove(path);
+    }
+
+    SearchServer reference(dictionary[0]);
+    auto apply = [&](SearchServer& server, size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 4), {static_cast<int>(i % 10), 3});
+            if (i % 7 == 6) {
+                server.RemoveDocument(i - 3);
+            }
+        }
+    };
+    apply(reference, 0, texts.size());
+    {
+        auto server = SearchServer::Recover(dictionary[0], checkpoint_path, wal_path);
+        apply(*server, 0, 200);
+        server->SyncWal();
+        filesystem::copy_file(wal_path, old_wal_path);
+        server->Checkpoint(checkpoint_path);
+        ASSERT_EQUAL(filesystem::file_size(wal_path), 0u);
+        apply(*server, 200, 400);
+    }
+    {
+        auto server = SearchServer::Recover(dictionary[0], checkpoint_path, wal_path);
+        apply(*server, 400, texts.size());
+    }
+    // сбой между записью контрольной точки и очисткой журнала: в журнале
+    // остались уже учтённые записи, и последняя запись оборвана
+    {
+        ifstream old_wal(old_wal_path, ios::binary);
+        ifstream wal(wal_path, ios::binary);
+        const string tail(istreambuf_iterator<char>(wal), {});
+        ofstream out(wal_path, ios::binary | ios::trunc);
+        out << old_wal.rdbuf() << tail << "torn record"s;
+    }
+    const auto recovered = SearchServer::Recover(dictionary[0], checkpoint_path, wal_path);
+    AssertSameSearchResults(reference, *recovered, queries);
+
+    // запись попадает в файл сразу, а на диск её сбрасывает фоновый поток без новых записей
+    {
+        filesystem::remove(wal_path);
+        WriteAheadLog::Options options;
+        options.group_commit_delay = chrono::milliseconds(5);
+        WriteAheadLog wal(wal_path, 1, options);
+        ASSERT_EQUAL(wal.GetSyncedLsn(), 0u);
+        ASSERT_EQUAL(wal.Append(1, "record"s), 1u);
+        ASSERT(filesystem::file_size(wal_path) > 0);
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (wal.GetSyncedLsn() < 1 && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        ASSERT_EQUAL(wal.GetSyncedLsn(), 1u);
+    }
+
+    // ConcurrentSearchServer пишет каждое изменение в журнал один раз, а отвергнутое — ни разу
+    {
+        filesystem::remove(checkpoint_path);
+        filesystem::remove(wal_path);
+        ConcurrentSearchServer concurrent(SearchServer::Recover(dictionary[0], checkpoint_path, wal_path));
+        for (size_t i = 0; i < 100; ++i) {
+            concurrent.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1});
+        }
+        ASSERT_THROWS(concurrent.AddDocument(0, texts[0], DocumentStatus::ACTUAL, {1}), invalid_argument);
+        concurrent.RemoveDocument(5);
+        concurrent.SyncWal();
+        size_t record_count = 0;
+        WriteAheadLog::Replay(wal_path, [&record_count](uint64_t, uint32_t, string_view) {
+            ++record_count;
+        });
+        ASSERT_EQUAL(record_count, 101u);
+        ASSERT_EQUAL(concurrent.GetDocumentCount(), 99);
+        ASSERT_EQUAL(SearchServer::Recover(dictionary[0], checkpoint_path, wal_path)->GetDocumentCount(), 99);
+
+        // контрольная точка очищает журнал, а восстановление берёт снимок и проигрывает только новые записи
+        concurrent.Checkpoint(checkpoint_path);
+        ASSERT_EQUAL(filesystem::file_size(wal_path), 0u);
+        for (size_t i = 100; i < 110; ++i) {
+            concurrent.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1});
+        }
+        concurrent.SyncWal();
+        record_count = 0;
+        WriteAheadLog::Replay(wal_path, [&record_count](uint64_t, uint32_t, string_view) {
+            ++record_count;
+        });
+        ASSERT_EQUAL(record_count, 10u);
+    }
+    const auto recovered_concurrent = SearchServer::Recover(dictionary[0], checkpoint_path, wal_path);
+    ASSERT_EQUAL(recovered_concurrent->GetDocumentCount(), 109);
+    ASSERT_THROWS(recovered_concurrent->MatchDocument(texts[5], 5), out_of_range);
+
+    for (const string& path : {checkpoint_path, wal_path, old_wal_path}) {
+        filesystem::remove(path);
+    }
+}
+
+// Сравнивает скорость изменений индекса без журнала, с групповой фиксацией
+// и со сбросом на диск после каждой операции
+void TestWriteAheadLogBenchmark() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 2'000, 30);
+    const auto directory = filesystem::temp_directory_path();
+    const string checkpoint_path = (directory / "search_server_bench.checkpoint"s).string();
+    const string wal_path = (directory / "search_server_bench.wal"s).string();
+
+    auto measure = [&](const string& mark, SearchServer& server) {
+        const auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < texts.size(); ++i) {
+            server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1});
+        }
+        server.SyncWal();
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        std::cerr << mark << ": "s << static_cast<int64_t>(texts.size() / max(seconds, 1e-9)) << " mutations/s"s << std::endl;
+    };
+    {
+        SearchServer server;
+        measure("WAL off"s, server);
+    }
+    for (const auto& [mark, mode] : {pair{"WAL group commit"s, WriteAheadLog::SyncMode::GROUP_COMMIT},
+                                     pair{"WAL fsync per operation"s, WriteAheadLog::SyncMode::EVERY_RECORD}}) {
+        filesystem::remove(wal_path);
+        WriteAheadLog::Options options;
+        options.sync_mode = mode;
+        auto server = SearchServer::Recover(""s, checkpoint_path, wal_path, options);
+        measure(mark, *server);
+    }
+    filesystem::remove(wal_path);
+}
+
+// Тест проверяет, что Block-Max WAND выдаёт те же документы, что и полный перебор,
+// и при этом действительно пропускает часть записей списков вхождений
+void TestBlockMaxWand() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    vector<string> documents;
+    for (int i = 0; i < 20'000; ++i) {
+        documents.push_back(GenerateSkewedText(generator, dictionary, 30));
+    }
+    SearchServer search_server;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        // уникальные рейтинги исключают неоднозначность при равной релевантности
+        search_server.AddDocument(i, documents[i], i % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL,
+                                  {static_cast<int>(i)});
+    }
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateSkewedText(generator, dictionary, 4));
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        queries[i] += " -"s + dictionary[i];
+    }
+
+    auto find_all = [&search_server, &queries](size_t top_k) {
+        vector<vector<Document>> results;
+        for (const string& query : queries) {
+            results.push_back(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, top_k));
+            results.push_back(search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, top_k));
+        }
+        return results;
+    };
+
+    for (const size_t top_k : {size_t(0), size_t(1), size_t(MAX_RESULT_DOCUMENT_COUNT), size_t(100)}) {
+        search_server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+        const auto expected = find_all(top_k);
+        search_server.SetRetrievalMode(RetrievalMode::BLOCK_MAX_WAND);
+        search_server.ResetRetrievalStats();
+        const auto actual = find_all(top_k);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            ASSERT_EQUAL(actual[i].size(), expected[i].size());
+            for (size_t j = 0; j < actual[i].size(); ++j) {
+                ASSERT_EQUAL(actual[i][j].id, expected[i][j].id);
+                ASSERT_EQUAL(actual[i][j].relevance, expected[i][j].relevance);
+                ASSERT_EQUAL(actual[i][j].rating, expected[i][j].rating);
+            }
+        }
+        if (top_k == MAX_RESULT_DOCUMENT_COUNT) {
+            const auto stats = search_server.GetRetrievalStats();
+            ASSERT(stats.postings_skipped > stats.postings_scored);
+            std::cerr << "Block-Max WAND skipped "s << stats.postings_skipped << " of "s
+                      << stats.postings_scored + stats.postings_skipped << " postings"s << std::endl;
+        }
+    }
+
+    search_server.SetRetrievalMode(RetrievalMode::EXHAUSTIVE);
+    {
+        LOG_DURATION("Exhaustive top 5"s);
+        find_all(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    search_server.SetRetrievalMode(RetrievalMode::BLOCK_MAX_WAND);
+    {
+        LOG_DURATION("Block-Max WAND top 5"s);
+        find_all(MAX_RESULT_DOCUMENT_COUNT);
+    }
+}
+
+// Печатает пропускную способность поиска с политикой policy и возвращает сумму релевантностей выдачи
 template <typename ExecutionPolicy>
-void TestWithExecutionPolicy(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
+double TestWithExecutionPolicy(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
+    const auto start = chrono::steady_clock::now();
     double total_relevance = 0;
     for (const string_view query : queries) {
         for (const auto& document : search_server.FindTopDocuments(policy, query)) {
             total_relevance += document.relevance;
         }
     }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    std::cerr << "Execution with "s << mark << ": "s << static_cast<int64_t>(queries.size() / max(seconds, 1e-9))
+              << " queries/s"s << std::endl;
+    return total_relevance;
 }
 
-#define TEST(policy) TestWithExecutionPolicy(#policy, search_server, queries, execution::policy)
-
 void TestWithExecutionPolicy_runner() {
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
@@ -472,10 +2416,20 @@ void TestWithExecutionPolicy_runner() {
         search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
     }
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
-    std::cerr << "Execution With "s;
-    TEST(seq);
-    std::cerr << "Execution With "s;
-    TEST(par);
+    const double seq_relevance = TestWithExecutionPolicy("seq"s, search_server, queries, execution::seq);
+    // параллельный подсчёт по диапазонам документов на пулах 1, 2, 4, ... потоков
+    // до числа ядер показывает, как он масштабируется, и должен давать ту же выдачу
+    const size_t hardware_threads = max(1u, thread::hardware_concurrency());
+    for (size_t thread_count = 1;; thread_count = min(thread_count * 2, hardware_threads)) {
+        search_server.SetThreadPool(make_shared<ThreadPool>(thread_count));
+        const double par_relevance = TestWithExecutionPolicy("par on "s + to_string(thread_count) + " threads"s,
+                                                             search_server, queries, execution::par);
+        ASSERT(std::abs(seq_relevance - par_relevance) < ACCURACY);
+        if (thread_count == hardware_threads) {
+            break;
+        }
+    }
+    search_server.SetThreadPool(nullptr);
     std::cerr << "Test ExecutionPolicy - OK? \n"s;  
 } 
 
@@ -496,7 +2450,36 @@ void TestSearchServer() {
     TestRunner tr;
     RUN_TEST(tr, TestConcurrentUpdate);
     RUN_TEST(tr, TestConcurrentReadAndWrite);
+    RUN_TEST(tr, TestSharedSpinLock);
+    RUN_TEST(tr, TestConcurrentMapOperations);
     RUN_TEST(tr, TestConcurrentSpeedup);
+    RUN_TEST(tr, TestPostingList);
+    RUN_TEST(tr, TestTermDictionary);
+    RUN_TEST(tr, TestTopK);
+    RUN_TEST(tr, TestBlockMaxWand);
+    RUN_TEST(tr, TestIdfCache);
+    RUN_TEST(tr, TestTextArena);
+    RUN_TEST(tr, TestAddDocuments);
+    RUN_TEST(tr, TestTokenizer);
+    RUN_TEST(tr, TestQueryParsingAllocations);
+    RUN_TEST(tr, TestRemoveDuplicates);
+    RUN_TEST(tr, TestRemoveDocuments);
+    RUN_TEST(tr, TestNearDuplicates);
+    RUN_TEST(tr, TestSegments);
+    RUN_TEST(tr, TestMergeOfLoadedSegments);
+    RUN_TEST(tr, TestTombstoneCompaction);
+    RUN_TEST(tr, TestStatusFilter);
+    RUN_TEST(tr, TestDocumentFilter);
+    RUN_TEST(tr, TestThreadPool);
+    RUN_TEST(tr, TestAsyncQueries);
+    RUN_TEST(tr, TestQueryCache);
+    RUN_TEST(tr, TestRequestQueue);
+    RUN_TEST(tr, TestConcurrentSearchServer);
+    RUN_TEST(tr, TestSnapshot);
+    RUN_TEST(tr, TestWriteAheadLog);
+    RUN_TEST(tr, TestWriteAheadLogBenchmark);
+    RUN_TEST(tr, TestRemoveDocument);
+    RUN_TEST(tr, TestPostingListBenchmark);
     TestWithExecutionPolicy_runner();
 }
 
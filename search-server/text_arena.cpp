@@ -0,0 +1,108 @@
+#include "text_arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+TextArena::TextId TextArena::Add(std::string_view text) {
+    if (text.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("Text is too long for TextArena");
+    }
+    return Insert(Store(chunks_, text));
+}
+
+uint32_t TextArena::AttachExternal(std::string_view block) {
+    // внешний блок заполнен целиком, поэтому Store в него не пишет
+    chunks_.push_back({nullptr, block.data(), block.size(), block.size()});
+    return static_cast<uint32_t>(chunks_.size() - 1);
+}
+
+TextArena::TextId TextArena::AddExternal(uint32_t block, size_t offset, size_t length) {
+    const Chunk& chunk = chunks_.at(block);
+    if (chunk.owned || offset > chunk.used || length > chunk.used - offset) {
+        throw std::out_of_range("Text is outside of the external block");
+    }
+    if (length > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("Text is too long for TextArena");
+    }
+    return Insert({block, static_cast<uint32_t>(length), offset, true});
+}
+
+std::string_view TextArena::Get(TextId text_id) const {
+    const Entry& entry = entries_.at(text_id);
+    if (!entry.live) {
+        throw std::out_of_range("Text was released");
+    }
+    if (entry.length == 0) {
+        return {};
+    }
+    return {chunks_[entry.chunk].data + entry.offset, entry.length};
+}
+
+void TextArena::Release(TextId text_id) {
+    Entry& entry = entries_.at(text_id);
+    if (!entry.live) {
+        return;
+    }
+    entry.live = false;
+    live_bytes_ -= entry.length;
+    released_bytes_ += entry.length;
+    free_ids_.push_back(text_id);
+    // уплотнение переписывает только живые байты, а их не больше освобождённых,
+    // поэтому его стоимость амортизируется освобождениями
+    if (released_bytes_ > live_bytes_ && released_bytes_ >= CHUNK_SIZE) {
+        Compact();
+    }
+}
+
+void TextArena::Compact() {
+    std::vector<Chunk> chunks;
+    for (Entry& entry : entries_) {
+        if (entry.live) {
+            const Chunk& chunk = chunks_[entry.chunk];
+            entry = Store(chunks, {chunk.data + entry.offset, entry.length});
+        }
+    }
+    chunks_ = std::move(chunks);
+    released_bytes_ = 0;
+}
+
+size_t TextArena::MemoryUsage() const {
+    size_t result = sizeof(*this) + chunks_.capacity() * sizeof(Chunk) + entries_.capacity() * sizeof(Entry)
+                    + free_ids_.capacity() * sizeof(TextId);
+    for (const Chunk& chunk : chunks_) {
+        result += chunk.owned ? chunk.capacity : 0;
+    }
+    return result;
+}
+
+TextArena::Entry TextArena::Store(std::vector<Chunk>& chunks, std::string_view text) {
+    if (text.empty()) {
+        return {0, 0, 0, true};
+    }
+    if (chunks.empty() || chunks.back().capacity - chunks.back().used < text.size()) {
+        // длинный текст получает отдельный блок по своему размеру
+        const size_t capacity = std::max(CHUNK_SIZE, text.size());
+        std::unique_ptr<char[]> owned(new char[capacity]);
+        const char* data = owned.get();
+        chunks.push_back({std::move(owned), data, capacity, 0});
+    }
+    Chunk& chunk = chunks.back();
+    std::memcpy(chunk.owned.get() + chunk.used, text.data(), text.size());
+    const Entry entry{static_cast<uint32_t>(chunks.size() - 1), static_cast<uint32_t>(text.size()), chunk.used, true};
+    chunk.used += text.size();
+    return entry;
+}
+
+TextArena::TextId TextArena::Insert(const Entry& entry) {
+    live_bytes_ += entry.length;
+    if (!free_ids_.empty()) {
+        const TextId text_id = free_ids_.back();
+        free_ids_.pop_back();
+        entries_[text_id] = entry;
+        return text_id;
+    }
+    entries_.push_back(entry);
+    return static_cast<TextId>(entries_.size() - 1);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Хранилище текстов документов. Тексты дописываются в большие блоки памяти,
+// добавление — O(1) без отдельной аллокации на каждый текст.
+// Каждый текст принадлежит своему документу и освобождается через Release;
+// когда освобождённых байт становится больше, чем живых, хранилище
+// уплотняется, переписывая живые тексты в новые блоки.
+// string_view из Get остаётся валидным до Release этого текста или Compact.
+// Тексты можно и не копировать: AddExternal ссылается на внешний блок памяти
+// (например, отображённый снимок), который должен жить не меньше хранилища.
+// Уплотнение переписывает живые внешние тексты в свои блоки.
+class TextArena {
+public:
+    using TextId = uint32_t;
+
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    TextId Add(std::string_view text);
+
+    // Подключает внешний блок текстов без копирования и возвращает его номер для AddExternal
+    uint32_t AttachExternal(std::string_view block);
+
+    // Добавляет текст, лежащий в подключённом блоке block с позиции offset, без копирования
+    TextId AddExternal(uint32_t block, size_t offset, size_t length);
+
+    std::string_view Get(TextId text_id) const;
+
+    // Освобождает текст; id может быть выдан следующему Add
+    void Release(TextId text_id);
+
+    // Переписывает живые тексты подряд в новые блоки и освобождает старые
+    void Compact();
+
+    // Число хранимых текстов
+    size_t size() const {
+        return entries_.size() - free_ids_.size();
+    }
+
+    // Суммарная длина хранимых текстов
+    size_t LiveBytes() const {
+        return live_bytes_;
+    }
+
+    // Объём памяти в байтах, занимаемый хранилищем
+    size_t MemoryUsage() const;
+
+private:
+    // блок памяти: свой (owned) или внешний, заполненный целиком
+    struct Chunk {
+        std::unique_ptr<char[]> owned;
+        const char* data = nullptr;
+        size_t capacity = 0;
+        size_t used = 0;
+    };
+
+    struct Entry {
+        uint32_t chunk = 0;
+        uint32_t length = 0;
+        size_t offset = 0;
+        bool live = false;
+    };
+
+    std::vector<Chunk> chunks_;
+    std::vector<Entry> entries_;
+    std::vector<TextId> free_ids_;
+    size_t live_bytes_ = 0;
+    size_t released_bytes_ = 0;
+
+    // Копирует текст в конец последнего блока, при нехватке места заводит новый
+    static Entry Store(std::vector<Chunk>& chunks, std::string_view text);
+
+    // Заводит запись для текста entry, свободный id берётся повторно
+    TextId Insert(const Entry& entry);
+};
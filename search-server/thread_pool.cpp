@@ -0,0 +1,149 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+
+// пул и номер рабочего потока, на котором выполняется код
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetDefault() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func) {
+    if (count == 0) {
+        return;
+    }
+    // Индексы раздаются по одному из общего счётчика: кто быстрее, тот берёт больше
+    struct Job {
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> remaining;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+    auto job = std::make_shared<Job>();
+    job->remaining = count;
+    auto run = [job, count, &func] {
+        for (size_t i = job->next.fetch_add(1); i < count; i = job->next.fetch_add(1)) {
+            try {
+                func(i);
+            } catch (...) {
+                std::lock_guard lock(job->error_mutex);
+                if (!job->error) {
+                    job->error = std::current_exception();
+                }
+            }
+            job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    };
+    // помощники, которые достались другим потокам после окончания работы, ничего не делают;
+    // func они не трогают, потому что все индексы к тому времени розданы
+    const size_t helper_count = std::min(count, GetThreadCount() + 1) - 1;
+    for (size_t i = 0; i < helper_count; ++i) {
+        Push(run);
+    }
+    run();
+    while (job->remaining.load(std::memory_order_acquire) > 0) {
+        if (!TryRunOne()) {
+            std::this_thread::yield();
+        }
+    }
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+void ThreadPool::Push(Task task) {
+    size_t index = GetCurrentWorker();
+    if (index == GetThreadCount()) {
+        index = next_worker_.fetch_add(1, std::memory_order_relaxed) % GetThreadCount();
+    }
+    {
+        std::lock_guard lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    pending_.fetch_add(1, std::memory_order_release);
+    // блокировка нужна, чтобы уведомление не проскочило между проверкой
+    // условия и засыпанием рабочего потока
+    {
+        std::lock_guard lock(sleep_mutex_);
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::TryRunOne() {
+    const size_t self = GetCurrentWorker();
+    Task task;
+    if (self < GetThreadCount()) {
+        Worker& worker = *workers_[self];
+        std::lock_guard lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+    }
+    for (size_t shift = 1; !task && shift <= GetThreadCount(); ++shift) {
+        Worker& victim = *workers_[(self + shift) % GetThreadCount()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+    task();
+    return true;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    while (true) {
+        if (TryRunOne()) {
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        wake_.wait(lock, [this] {
+            return stop_ || pending_.load(std::memory_order_acquire) > 0;
+        });
+        if (stop_ && pending_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::GetCurrentWorker() const {
+    return current_pool == this ? current_worker : GetThreadCount();
+}
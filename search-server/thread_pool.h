@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Пул потоков с перехватом работы. У каждого рабочего потока своя очередь задач:
+// свои задачи он берёт с конца, а оставшись без работы, забирает задачи
+// из начала чужих очередей. Поток, ждущий завершения ParallelFor, сам выполняет
+// задачи пула, поэтому ParallelFor можно вызывать изнутри задач (запрос внутри
+// пакета запросов) без взаимной блокировки и без лишних потоков.
+// Рабочие потоки живут столько же, сколько пул, поэтому их thread_local-память
+// (например, накопители релевантности) переиспользуется между задачами.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = std::max(1u, std::thread::hardware_concurrency()));
+
+    // Дожидается выполнения поставленных задач и останавливает потоки
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const {
+        return workers_.size();
+    }
+
+    // Выполняет func(i) для всех i из [0, count) на потоках пула и на вызывающем потоке.
+    // Возвращается, когда выполнены все вызовы; первое выброшенное исключение
+    // пробрасывается вызывающему после этого.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+    // Ставит func() в очередь пула и сразу возвращает future с её результатом или исключением
+    template <typename Func>
+    std::future<std::invoke_result_t<Func>> Submit(Func func);
+
+    // Общий пул на hardware_concurrency() потоков, создаётся при первом обращении
+    static ThreadPool& GetDefault();
+
+private:
+    using Task = std::function<void()>;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // заполняется до запуска потоков и дальше не меняется, поэтому рабочие потоки
+    // читают его без блокировки; threads_ они не читают — его дописывает конструктор
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_ = 0;
+    std::atomic<size_t> next_worker_ = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+
+    void Push(Task task);
+
+    // Выполняет одну задачу: свою с конца очереди или чужую с начала
+    bool TryRunOne();
+
+    void WorkerLoop(size_t index);
+
+    // Номер рабочего потока этого пула, на котором идёт вызов, или GetThreadCount()
+    size_t GetCurrentWorker() const;
+};
+
+template <typename Func>
+std::future<std::invoke_result_t<Func>> ThreadPool::Submit(Func func) {
+    // std::function требует копируемой задачи, а packaged_task только перемещается
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Func>()>>(std::move(func));
+    auto future = task->get_future();
+    Push([task] {
+        (*task)();
+    });
+    return future;
+}
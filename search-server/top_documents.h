@@ -0,0 +1,82 @@
+#pragma once
+#include "document.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const double ACCURACY = 1e-6;
+
+// Порядок выдачи: по убыванию релевантности, при равной (с точностью ACCURACY)
+// релевантности — по убыванию рейтинга, затем по возрастанию id, чтобы выдача
+// не зависела от того, как индекс разбит на сегменты и диапазоны
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < ACCURACY) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    } else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
+// Ограниченная куча из не более чем capacity лучших документов.
+// На вершине кучи лежит худший из отобранных документов, поэтому
+// Push отсекает заведомо неподходящие документы за O(1), а остальные
+// добавляет за O(log capacity). Место под кучу выделяется один раз, при первом
+// Push, сразу на всю выдачу (если она не больше RESERVE_LIMIT документов):
+// куча затем отдаётся как результат запроса, и это единственное выделение
+// памяти под выдачу.
+class TopDocuments {
+public:
+    static constexpr size_t RESERVE_LIMIT = 1024;
+
+    explicit TopDocuments(size_t capacity) : capacity_(capacity) {
+    }
+
+    void Push(const Document& document) {
+        if (capacity_ == 0) {
+            return;
+        }
+        if (heap_.size() < capacity_) {
+            if (heap_.capacity() == 0) {
+                heap_.reserve(std::min(capacity_, RESERVE_LIMIT));
+            }
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        } else if (IsMoreRelevant(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+    }
+
+    void Merge(const TopDocuments& other) {
+        for (const Document& document : other.heap_) {
+            Push(document);
+        }
+    }
+
+    bool IsFull() const {
+        return heap_.size() == capacity_;
+    }
+
+    // Худший из отобранных документов; куча не должна быть пустой
+    const Document& Worst() const {
+        return heap_.front();
+    }
+
+    size_t size() const {
+        return heap_.size();
+    }
+
+    // Возвращает отобранные документы в порядке выдачи
+    std::vector<Document> Extract() && {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return std::move(heap_);
+    }
+
+private:
+    size_t capacity_;
+    std::vector<Document> heap_;
+};
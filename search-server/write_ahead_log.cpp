@@ -0,0 +1,207 @@
+#include "write_ahead_log.h"
+#include "checksum.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+void WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Cannot write to write-ahead log");
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t next_lsn, Options options)
+    : options_(options), next_lsn_(next_lsn), synced_lsn_(next_lsn - 1) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open write-ahead log " + path);
+    }
+    if (options_.sync_mode == SyncMode::GROUP_COMMIT) {
+        flusher_ = std::thread([this] {
+            FlusherLoop();
+        });
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (flusher_.joinable()) {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        unsynced_.notify_one();
+        flusher_.join();
+    }
+    try {
+        Sync();
+    } catch (...) {
+    }
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::Append(uint32_t type, std::string_view payload) {
+    std::unique_lock lock(mutex_);
+    RethrowFlushError();
+    RecordHeader header{static_cast<uint32_t>(payload.size()), type, next_lsn_, 0};
+    header.checksum = ComputeChecksum(header, payload);
+    // заголовок и данные уходят одним write
+    buffer_.clear();
+    buffer_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer_.append(payload);
+    WriteAll(fd_, buffer_.data(), buffer_.size());
+    const uint64_t lsn = next_lsn_++;
+    if (options_.sync_mode == SyncMode::EVERY_RECORD || lsn - synced_lsn_ >= options_.group_commit_size) {
+        SyncLocked(lock);
+    } else if (lsn - synced_lsn_ == 1) {
+        first_unsynced_time_ = std::chrono::steady_clock::now();
+        unsynced_.notify_one();
+    }
+    return lsn;
+}
+
+void WriteAheadLog::Sync() {
+    std::unique_lock lock(mutex_);
+    RethrowFlushError();
+    SyncLocked(lock);
+}
+
+uint64_t WriteAheadLog::GetSyncedLsn() const {
+    std::lock_guard lock(mutex_);
+    return synced_lsn_;
+}
+
+void WriteAheadLog::SyncLocked(std::unique_lock<std::mutex>& lock) {
+    const uint64_t target = next_lsn_ - 1;
+    if (synced_lsn_ >= target) {
+        return;
+    }
+    lock.unlock();
+    const int result = fdatasync(fd_);
+    lock.lock();
+    if (result != 0) {
+        throw std::runtime_error("Cannot sync write-ahead log");
+    }
+    synced_lsn_ = std::max(synced_lsn_, target);
+}
+
+void WriteAheadLog::RethrowFlushError() {
+    if (flush_error_) {
+        std::rethrow_exception(std::exchange(flush_error_, nullptr));
+    }
+}
+
+void WriteAheadLog::FlusherLoop() {
+    std::unique_lock lock(mutex_);
+    while (!stop_) {
+        if (synced_lsn_ + 1 >= next_lsn_) {
+            unsynced_.wait(lock);
+            continue;
+        }
+        const auto deadline = first_unsynced_time_ + options_.group_commit_delay;
+        if (std::chrono::steady_clock::now() < deadline) {
+            unsynced_.wait_until(lock, deadline);
+            continue;
+        }
+        try {
+            SyncLocked(lock);
+        } catch (...) {
+            flush_error_ = std::current_exception();
+            // следующая попытка — ещё через group_commit_delay
+            first_unsynced_time_ = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+void WriteAheadLog::Reset() {
+    std::lock_guard lock(mutex_);
+    if (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0) {
+        throw std::runtime_error("Cannot truncate write-ahead log");
+    }
+    synced_lsn_ = next_lsn_ - 1;
+}
+
+uint64_t WriteAheadLog::Replay(const std::string& path,
+                               const std::function<void(uint64_t, uint32_t, std::string_view)>& callback) {
+    const int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        throw std::runtime_error("Cannot open write-ahead log " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat write-ahead log " + path);
+    }
+    std::vector<char> data(static_cast<size_t>(file_stat.st_size));
+    size_t read_size = 0;
+    while (read_size < data.size()) {
+        const ssize_t result = read(fd, data.data() + read_size, data.size() - read_size);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            close(fd);
+            throw std::runtime_error("Cannot read write-ahead log " + path);
+        }
+        read_size += static_cast<size_t>(result);
+    }
+
+    uint64_t last_lsn = 0;
+    size_t offset = 0;
+    try {
+        while (data.size() - offset >= sizeof(RecordHeader)) {
+            RecordHeader header;
+            std::memcpy(&header, data.data() + offset, sizeof(header));
+            if (header.payload_size > data.size() - offset - sizeof(header)) {
+                break;
+            }
+            const std::string_view payload(data.data() + offset + sizeof(header), header.payload_size);
+            if (ComputeChecksum(header, payload) != header.checksum || header.lsn <= last_lsn) {
+                break;
+            }
+            callback(header.lsn, header.type, payload);
+            last_lsn = header.lsn;
+            offset += sizeof(header) + header.payload_size;
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    // хвост после последней целой записи — след прерванной записи, его отбрасываем
+    if (offset < data.size() && (ftruncate(fd, static_cast<off_t>(offset)) != 0 || fdatasync(fd) != 0)) {
+        close(fd);
+        throw std::runtime_error("Cannot truncate write-ahead log " + path);
+    }
+    close(fd);
+    return last_lsn;
+}
+
+uint64_t WriteAheadLog::ComputeChecksum(const RecordHeader& header, std::string_view payload) {
+    Checksum checksum;
+    checksum.Update(reinterpret_cast<const char*>(&header), offsetof(RecordHeader, checksum));
+    checksum.Update(payload.data(), payload.size());
+    return checksum.Finish();
+}
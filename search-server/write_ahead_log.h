@@ -0,0 +1,94 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Журнал упреждающей записи: последовательность записей с возрастающими
+// номерами (LSN), каждая со своей контрольной суммой.
+// Append передаёт запись в файл до возврата, поэтому падение процесса записей
+// не теряет. В режиме GROUP_COMMIT общим становится только fdatasync: он делается,
+// когда набирается group_commit_size несброшенных записей, при Sync или фоновым
+// потоком через group_commit_delay после первой несброшенной записи, даже если
+// новых записей нет. Поэтому при сбое ОС теряются записи не более чем за
+// group_commit_delay и не больше group_commit_size. В режиме EVERY_RECORD
+// каждая запись сбрасывается на диск до возврата из Append.
+// Ошибка фонового сброса выбрасывается из следующего Append или Sync.
+class WriteAheadLog {
+public:
+    enum class SyncMode {
+        GROUP_COMMIT,
+        EVERY_RECORD,
+    };
+
+    struct Options {
+        SyncMode sync_mode = SyncMode::GROUP_COMMIT;
+        size_t group_commit_size = 256;
+        std::chrono::milliseconds group_commit_delay{10};
+    };
+
+    // Открывает журнал для дописывания; номера новых записей начнутся с next_lsn
+    WriteAheadLog(const std::string& path, uint64_t next_lsn, Options options);
+
+    // Сбрасывает на диск несброшенные записи
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Дописывает запись и возвращает её LSN
+    uint64_t Append(uint32_t type, std::string_view payload);
+
+    void Sync();
+
+    // LSN последней записи, сброшенной на диск, или номер, предшествующий первой записи
+    uint64_t GetSyncedLsn() const;
+
+    // Очищает журнал после контрольной точки; нумерация записей продолжается
+    void Reset();
+
+    // Вызывает callback(lsn, type, payload) для записей журнала по порядку.
+    // Чтение останавливается на первой неполной или повреждённой записи
+    // (обрыв при сбое), и файл обрезается до последней целой записи.
+    // Возвращает LSN последней прочитанной записи или 0. Отсутствующий файл — пустой журнал.
+    static uint64_t Replay(const std::string& path,
+                           const std::function<void(uint64_t lsn, uint32_t type, std::string_view payload)>& callback);
+
+private:
+    struct RecordHeader {
+        uint32_t payload_size;
+        uint32_t type;
+        uint64_t lsn;
+        uint64_t checksum;
+    };
+
+    int fd_ = -1;
+    Options options_;
+    // защищает всё ниже; fdatasync идёт без неё, чтобы не задерживать Append
+    mutable std::mutex mutex_;
+    uint64_t next_lsn_;
+    uint64_t synced_lsn_;
+    std::chrono::steady_clock::time_point first_unsynced_time_;
+    std::string buffer_;
+    std::exception_ptr flush_error_;
+    bool stop_ = false;
+    std::condition_variable unsynced_;
+    // фоновый сброс по group_commit_delay; только в режиме GROUP_COMMIT
+    std::thread flusher_;
+
+    // Сбрасывает на диск записи, переданные в файл до вызова
+    void SyncLocked(std::unique_lock<std::mutex>& lock);
+
+    // Выбрасывает ошибку фонового сброса, если она была
+    void RethrowFlushError();
+
+    void FlusherLoop();
+
+    static uint64_t ComputeChecksum(const RecordHeader& header, std::string_view payload);
+};